@@ -20,6 +20,9 @@
 #include "genoFind.h"
 #include "trans3.h"
 #include "gfClientLib.h"
+#include "numaMem.h"
+#include "portable.h"
+#include "htslib/hts.h"
 
 #include <sys/types.h>
 #include <pthread.h>
@@ -35,10 +38,15 @@ unsigned long databaseLetters = 0;	/* Number of bases in database. */
 
 enum constants {
     qWarnSize = 5000000, /* Warn if more than this many bases in one query. */
+    outBufSize = 1024*1024, /* Size of buffer for each output file. */
 };
 
 /* Rank id of MPI */
 int myid;
+/* Number of MPI processes, which is the number of parts each query file is
+ * split into, and the part searched by the first thread on this node. */
+int numproc;
+int firstPart;
 
 /* Variables that can be set from command line. */
 int threads = 1;
@@ -65,6 +73,19 @@ char *qMask = NULL;
 double minRepDivergence = 15;
 double minIdentity = 90;
 char *outputFormat = "psl";
+char *numaPolicy = NULL;
+boolean bindThreads = FALSE;
+boolean dedupQueries = FALSE;
+char *resultCache = NULL;
+char *cacheFingerprint = NULL;	/* md5 of database and settings for -resultCache. */
+int checkpointEvery = 0;	/* Seconds between checkpoints, 0 for none. */
+boolean resume = FALSE;
+boolean bcastDb = FALSE;
+boolean streamOut = FALSE;
+int bestN = 0;
+int hitBudget = 0;
+boolean preScreen = FALSE;
+int batchSize = 0;
 
 
 void usage()
@@ -78,6 +99,11 @@ void usage()
         "   mpirun -n <N> pblat-cluster database query [-ooc=11.ooc] output.psl\n"
         "where:\n"
         "   database and query are each a .fa file.\n"
+        "   query may also be a file listing query .fa files, one per line.  They\n"
+        "               are all searched against one index of the database.  The\n"
+        "               output is then a directory, holding one output file for\n"
+        "               each query file, named after it with the output format\n"
+        "               as extension, e.g. output/sample1.psl for sample1.fa.\n"
         "   -ooc=11.ooc tells the program to load over-occurring 11-mers from\n"
         "               an external file.  This will increase the speed\n"
         "               by a factor of 40 in many cases, but is not required.\n"
@@ -147,6 +173,8 @@ void usage()
         "   -out=type   Controls output file format.  Type is one of:\n"
         "                   psl - Default.  Tab separated format, no sequence\n"
         "                   pslx - Tab separated format with sequence\n"
+        "                   pslb - Binary psl, quick to write.  Convert to psl\n"
+        "                          with pslbToPsl\n"
         "                   axt - blastz-associated axt format\n"
         "                   maf - multiz-associated maf format\n"
         "                   sim4 - similar to sim4 format\n"
@@ -158,7 +186,92 @@ void usage()
         "               terminal exons.  Not recommended for ESTs.\n"
         "   -maxIntron=N  Sets maximum intron size. Default is %d.\n"
         "   -extendThroughN   Allows extension of alignment through large blocks of Ns.\n"
-        , gfVersion, MAXSINGLEPIECESIZE, ffIntronMaxDefault
+        "   -numa=type  Placement of index on machines with several NUMA nodes.\n"
+        "               Type is one of:\n"
+        "                   interleave - spread index evenly over all nodes\n"
+        "                   replicate - keep a copy of index on each node, and\n"
+        "                               bind threads to nodes (implies -bindThreads)\n"
+        "   -bindThreads  Bind search threads to NUMA nodes in round robin order.\n"
+        "   -packIndex  Keep index position lists delta encoded.  Uses less memory\n"
+        "               for the index but is slower.  Has no effect for DNA tile\n"
+        "               sizes over 12 or protein tile sizes over 5.\n"
+        "   -spacedSeed Use a spaced seed with tileSize bases that matter rather than\n"
+        "               tileSize contiguous bases as the tiles of a DNA index.  More\n"
+        "               sensitive to divergent sequence than contiguous tiles, and\n"
+        "               much faster than -oneOff.  Only for tile sizes up to 12,\n"
+        "               and not with -oneOff, -ooc or -makeOoc.\n"
+        "   -sufaSeed=N Seed DNA alignments from exact matches of at least N bases\n"
+        "               found in a suffix array of the database, rather than from\n"
+        "               tiles.  Each match is taken as long as it will go, along with\n"
+        "               up to repMatch other places matching at least N bases from\n"
+        "               the same start.  Matches found more than repMatch times are\n"
+        "               skipped.  Good for short reads in repetitive genomes.  Less\n"
+        "               sensitive than tiles to diverged copies of repeats, which\n"
+        "               need matches of N bases in step with the best copy to be\n"
+        "               seeded.  N can't be less than tileSize.\n"
+        "               The suffix array takes about 4 bytes a base, and building it\n"
+        "               about 16 more for a while.  Not with -oneOff.\n"
+        "   -sufa=file  Use suffix array in file, as made by sufaMake, for -sufaSeed\n"
+        "               rather than building one.\n"
+        "   -dedupQueries  Align each distinct query sequence only once per process,\n"
+        "               and write the output for later copies of it by renaming.\n"
+        "               Only works with psl, pslx, blast8 and blast9 output.\n"
+        "   -resultCache=dir  Keep output for each query sequence in dir, and reuse\n"
+        "               it in later runs against the same database with the same\n"
+        "               settings rather than aligning the sequence again.  Works\n"
+        "               with the same output formats as -dedupQueries.\n"
+        "   -checkpoint=N  Every N seconds flush the output and record in\n"
+        "               output.ckpt.<part> how far each part of the query has got.\n"
+        "               The query is split in one part per process.  Only for .fa\n"
+        "               queries against a DNA or protein database.\n"
+        "   -resume     Carry on from the checkpoints of an earlier run with the same\n"
+        "               database, query, output and number of processes, rather than\n"
+        "               starting over.  Parts with no checkpoint are started over.\n"
+        "   -bcastDb    Have only rank 0 read the database, and send it to the other\n"
+        "               nodes over MPI, rather than every node reading it from\n"
+        "               shared storage.\n"
+        "   -streamOut  Write axt and maf alignments as they are made rather than\n"
+        "               at the end of each query.  Saves memory on queries with\n"
+        "               many alignments, but they come out in a different order.\n"
+        "               Without it a query's axt or maf alignments are held until\n"
+        "               it is done, or until they reach 64MB per thread.\n"
+        "   -bestN=N    Only extend clumps of hits that cover as much of the query\n"
+        "               as the N best clumps of the query found so far.  Saves\n"
+        "               time on queries in repeats that hit many places.  Queries\n"
+        "               over %d bases are searched in pieces, each with its own\n"
+        "               N best.  Only for DNA queries against DNA, and not with\n"
+        "               -fine.\n"
+        "   -hitBudget=N  Let seeding find at most N hits for a query on a strand,\n"
+        "               split between the frames of translated searches.  Before\n"
+        "               looking any up, the query's tiles that are most common in\n"
+        "               the database are dropped until the rest fit.  Bounds the\n"
+        "               time spent on low complexity and repeat queries.  The\n"
+        "               number of queries this happens to is reported at the end.\n"
+        "   -preScreen  Before aligning a DNA query against DNA, add up how often\n"
+        "               its tiles occur in the database, and skip it if that is too\n"
+        "               few for any alignment.  Saves time when most queries have\n"
+        "               no alignments, and doesn't change output.\n"
+        "   -batch=N    Align DNA queries against DNA N at a time, looking up the\n"
+        "               tiles of all N together.  Speeds up short reads.  Queries\n"
+        "               over %d bases are still aligned one at a time.  Not with\n"
+        "               -fine, -dedupQueries or -resultCache.\n"
+        "   -minimizerWindow=N  Index only the (N,tileSize) minimizers of the\n"
+        "               database rather than every stepSize'th tile, and look up\n"
+        "               only the minimizers of the query.  Any stretch of\n"
+        "               N+tileSize-1 bases shared by query and database is still\n"
+        "               seeded, but only about 2/(N+1) of positions are indexed.\n"
+        "               Only for DNA with tile sizes up to 12, and not with -oneOff.\n"
+        "   -hugePages=type  Back index with huge pages to cut down on TLB misses.\n"
+        "               Type is one of:\n"
+        "                   thp - transparent huge pages\n"
+        "                   2M or 1G - pages of that size from the hugetlb pool\n"
+        "                   dir - a file in the hugetlbfs mounted on dir\n"
+        "               The page size obtained is reported with -verbose=2.\n"
+        "   -slabAlloc  Use a per-thread caching memory allocator rather than plain\n"
+        "               malloc.  Helps when running many threads per node.  With\n"
+        "               -verbose=2 allocator statistics are written to stderr.\n"
+        , gfVersion, MAXSINGLEPIECESIZE, ffIntronMaxDefault, MAXSINGLEPIECESIZE,
+          MAXSINGLEPIECESIZE
     );
     exit(0);
 }
@@ -192,6 +305,25 @@ struct optionSpec options[] = {
     {"fine", OPTION_BOOLEAN},
     {"maxIntron", OPTION_INT},
     {"extendThroughN", OPTION_BOOLEAN},
+    {"numa", OPTION_STRING},
+    {"bindThreads", OPTION_BOOLEAN},
+    {"hugePages", OPTION_STRING},
+    {"packIndex", OPTION_BOOLEAN},
+    {"spacedSeed", OPTION_BOOLEAN},
+    {"sufaSeed", OPTION_INT},
+    {"sufa", OPTION_STRING},
+    {"dedupQueries", OPTION_BOOLEAN},
+    {"resultCache", OPTION_STRING},
+    {"minimizerWindow", OPTION_INT},
+    {"checkpoint", OPTION_INT},
+    {"resume", OPTION_BOOLEAN},
+    {"bcastDb", OPTION_BOOLEAN},
+    {"streamOut", OPTION_BOOLEAN},
+    {"bestN", OPTION_INT},
+    {"hitBudget", OPTION_INT},
+    {"preScreen", OPTION_BOOLEAN},
+    {"batch", OPTION_INT},
+    {"slabAlloc", OPTION_BOOLEAN},
     {NULL, 0},
 };
 
@@ -216,11 +348,12 @@ void searchOneProt(aaSeq *seq, struct genoFind *gf, FILE *f, struct gfOutput *gv
 /* Search for protein seq in index and write results to psl. */
 {
     int hitCount;
-    struct lm *lm = lmInit(0);
-    struct gfClump *clumpList = gfFindClumps(gf, seq, lm, &hitCount);
+    struct lm *lm = gfWorkspaceForThread()->lm;
+    struct gfClump *clumpList;
+    lmReset(lm);
+    clumpList = gfFindClumps(gf, seq, lm, &hitCount);
     gfAlignAaClumps(gf, clumpList, seq, FALSE, minScore, gvo);
     gfClumpFreeList(&clumpList);
-    lmCleanup(&lm);
 }
 
 void dotOut()
@@ -316,8 +449,19 @@ void searchOneMaskTrim(struct dnaSeq *seq, boolean isProt,
 {
     boolean maskQuery = (qMask != NULL);
     boolean lcMask = (qMask != NULL && sameWord(qMask, "lower"));
-    Bits *qMaskBits = maskQuerySeq(seq, isProt, maskQuery, lcMask);
+    Bits *qMaskBits;
     struct dnaSeq trimmedSeq;
+    if (preScreen && !isProt && !gfQueryMayHit(gf, seq))
+    {
+        /* Masking and trimming only take tiles away, so no need to do
+         * them to tell there will be no alignments. */
+        dotOut();
+        gfOutputQuery(gvo, outFile);
+        *retTotalSize += seq->size;
+        *retCount += 1;
+        return;
+    }
+    qMaskBits = maskQuerySeq(seq, isProt, maskQuery, lcMask);
     ZeroVar(&trimmedSeq);
     trimSeq(seq, &trimmedSeq);
     if (qType == gftRna || qType == gftRnaX)
@@ -329,6 +473,653 @@ void searchOneMaskTrim(struct dnaSeq *seq, boolean isProt,
 }
 
 
+/* Output cached by -dedupQueries is limited to this many bytes per process.
+ * Past that queries not seen before are aligned but not remembered. */
+#define dedupCacheMax (1024*1024*1024)
+
+struct dedupQuery
+/* Output of a query, saved to write again for later copies of it. */
+{
+    char *name;		/* Name of query the output is for. */
+    char *output;	/* Its output. */
+    size_t outputSize;	/* Size of output. */
+};
+
+boolean dedupFormat()
+/* Return TRUE if output format is one where the output of a copy of a
+ * query can be made just by renaming the query.  These are the tab
+ * separated ones, where the name is a field of its own. */
+{
+    return sameWord(outputFormat, "psl") || sameWord(outputFormat, "pslx") ||
+           sameWord(outputFormat, "blast8") || sameWord(outputFormat, "blast9");
+}
+
+void writeRenamed(struct dedupQuery *dq, char *name, FILE *f)
+/* Write out saved output, with dq->name changed to name. */
+{
+    boolean isPsl = sameWord(outputFormat, "psl") || sameWord(outputFormat, "pslx");
+    int nameField = (isPsl ? 9 : 0);
+    int oldNameSize = strlen(dq->name);
+    char *s = dq->output, *end = dq->output + dq->outputSize;
+    while (s < end)
+    {
+        char *e = memchr(s, '\n', end - s);
+        char *field = s;
+        int i;
+        e = (e == NULL ? end : e + 1);
+        if (startsWith("# Query: ", s))
+            field = s + strlen("# Query: ");
+        else if (s[0] != '#')
+        {
+            for (i=0; i<nameField && field != NULL; i++)
+            {
+                field = memchr(field, '\t', e - field);
+                if (field != NULL)
+                    field += 1;
+            }
+        }
+        else
+            field = NULL;
+        if (field != NULL && field + oldNameSize < e &&
+            memcmp(field, dq->name, oldNameSize) == 0 &&
+            (field[oldNameSize] == '\t' || field[oldNameSize] == '\n'))
+        {
+            mustWrite(f, s, field - s);
+            fputs(name, f);
+            s = field + oldNameSize;
+        }
+        mustWrite(f, s, e - s);
+        s = e;
+    }
+}
+
+/* Output of queries searched so far for -dedupQueries, keyed by sequence.
+ * This is shared by all threads of the process.  Entries are only added
+ * once their output is complete, and aren't changed after that. */
+struct hash *dedupHash = NULL;
+size_t dedupSize = 0;		/* Bytes held in dedupHash. */
+pthread_mutex_t dedupMutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct dedupQuery *dedupFind(char *dna)
+/* Return saved output for query sequence, or NULL if there is none. */
+{
+    struct dedupQuery *dq;
+    pthread_mutex_lock(&dedupMutex);
+    dq = hashFindVal(dedupHash, dna);
+    pthread_mutex_unlock(&dedupMutex);
+    return dq;
+}
+
+boolean dedupFull()
+/* Return TRUE if no more output can be saved. */
+{
+    boolean full;
+    pthread_mutex_lock(&dedupMutex);
+    full = (dedupSize >= dedupCacheMax);
+    pthread_mutex_unlock(&dedupMutex);
+    return full;
+}
+
+boolean dedupAdd(char *dna, struct dedupQuery *dq)
+/* Save output of query sequence for later copies of it.  Return FALSE if
+ * it isn't saved, because there is no room or another thread already
+ * saved output for the same sequence, in which case dq is still the
+ * caller's. */
+{
+    boolean added = FALSE;
+    pthread_mutex_lock(&dedupMutex);
+    if (dedupSize < dedupCacheMax && hashLookup(dedupHash, dna) == NULL)
+    {
+        hashAdd(dedupHash, dna, dq);
+        dedupSize += strlen(dna) + strlen(dq->name) + sizeof(*dq) + dq->outputSize;
+        added = TRUE;
+    }
+    pthread_mutex_unlock(&dedupMutex);
+    return added;
+}
+
+void freeDedupQuery(void **pVal)
+/* Free up a dedupQuery in a hash. */
+{
+    struct dedupQuery *dq = *pVal;
+    freeMem(dq->name);
+    free(dq->output);	/* From open_memstream or malloc, so not freeMem. */
+    freez(pVal);
+}
+
+char *cacheQueryPath(struct dnaSeq *seq)
+/* Return path of file in -resultCache for query sequence.  This is
+ * named by md5 of the sequence, in a directory named by the fingerprint
+ * of database and settings.  Free with freeMem. */
+{
+    hts_md5_context *md5 = hts_md5_init();
+    unsigned char digest[16];
+    char hex[33];
+    char path[PATH_LEN];
+
+    if (md5 == NULL)
+        errAbort("Out of memory making md5 context");
+    hts_md5_update(md5, seq->dna, seq->size);
+    hts_md5_final(digest, md5);
+    hts_md5_destroy(md5);
+    hts_md5_hex(hex, digest);
+    safef(path, sizeof(path), "%s/%s/%c%c/%s", resultCache, cacheFingerprint,
+          hex[0], hex[1], hex);
+    return cloneString(path);
+}
+
+struct dedupQuery *cacheLoad(char *path)
+/* Load output saved in result cache file, or return NULL if there is none.
+ * The file has the name of the query the output was made for on the first
+ * line, and the output after that. */
+{
+    struct dedupQuery *dq;
+    FILE *f = fopen(path, "rb");
+    char *buf, *nl;
+    long size;
+
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != size)
+        errnoAbort("Couldn't read %s", path);
+    fclose(f);
+    buf[size] = 0;
+    if ((nl = memchr(buf, '\n', size)) == NULL)
+        errAbort("%s is not a result cache file", path);
+    AllocVar(dq);
+    dq->name = cloneStringZ(buf, nl - buf);
+    dq->outputSize = size - (nl + 1 - buf);
+    memmove(buf, nl + 1, dq->outputSize);
+    dq->output = buf;
+    return dq;
+}
+
+void cacheSave(char *path, struct dedupQuery *dq)
+/* Save output in result cache file.  This is written under a temporary
+ * name and renamed, so other processes never see part of one. */
+{
+    char dir[PATH_LEN], tmpPath[PATH_LEN];
+    FILE *f;
+
+    splitPath(path, dir, NULL, NULL);
+    makeDirsOnPath(dir);
+    safef(tmpPath, sizeof(tmpPath), "%s.tmp.%d.%lx", path, (int)getpid(),
+          (unsigned long)pthread_self());
+    f = mustOpen(tmpPath, "wb");
+    fprintf(f, "%s\n", dq->name);
+    mustWrite(f, dq->output, dq->outputSize);
+    carefulClose(&f);
+    if (rename(tmpPath, path) < 0)
+        errnoAbort("Couldn't rename %s to %s", tmpPath, path);
+}
+
+void searchOneCached(struct dnaSeq *seq, boolean isProt,
+                     struct genoFind *gf, FILE *outFile,
+                     struct hash *maskHash,
+                     long long *retTotalSize, int *retCount,
+                     struct gfOutput *gvo)
+/* Search a single sequence, unless the same sequence has been searched
+ * before, in which case just write out output saved from that time
+ * under the new name.  Output is saved in dedupHash with -dedupQueries,
+ * and also in the -resultCache directory if there is one.  Search every
+ * sequence if there is neither. */
+{
+    struct dedupQuery *dq;
+    FILE *mem, *oldFile;
+    char *path = NULL, *dna = NULL;
+
+    if (dedupHash == NULL && resultCache == NULL)
+    {
+        searchOneMaskTrim(seq, isProt, gf, outFile, maskHash, retTotalSize, retCount, gvo);
+        return;
+    }
+    if (dedupHash != NULL && (dq = dedupFind(seq->dna)) != NULL)
+    {
+        writeRenamed(dq, seq->name, outFile);
+        gvo->queryIx += 1;
+        *retTotalSize += seq->size;
+        *retCount += 1;
+        return;
+    }
+    if (resultCache != NULL)
+    {
+        path = cacheQueryPath(seq);
+        dq = cacheLoad(path);
+        if (dq != NULL)
+        {
+            writeRenamed(dq, seq->name, outFile);
+            gvo->queryIx += 1;
+            *retTotalSize += seq->size;
+            *retCount += 1;
+            if (dedupHash == NULL || !dedupAdd(seq->dna, dq))
+                freeDedupQuery((void **)&dq);
+            freeMem(path);
+            return;
+        }
+    }
+    else if (dedupFull())
+    {
+        searchOneMaskTrim(seq, isProt, gf, outFile, maskHash, retTotalSize, retCount, gvo);
+        return;
+    }
+
+    /* Save sequence before searching massages it, then search with
+     * output going to memory. */
+    AllocVar(dq);
+    dq->name = cloneString(seq->name);
+    if (dedupHash != NULL)
+        dna = cloneStringZ(seq->dna, seq->size);
+    mem = open_memstream(&dq->output, &dq->outputSize);
+    if (mem == NULL)
+        errnoAbort("Couldn't open memory stream");
+    oldFile = gfOutputSetFile(gvo, mem);
+    searchOneMaskTrim(seq, isProt, gf, mem, maskHash, retTotalSize, retCount, gvo);
+    gfOutputSetFile(gvo, oldFile);
+    carefulClose(&mem);
+    mustWrite(outFile, dq->output, dq->outputSize);
+    if (path != NULL)
+    {
+        cacheSave(path, dq);
+        freeMem(path);
+    }
+    if (dna == NULL || !dedupAdd(dna, dq))
+        freeDedupQuery((void **)&dq);
+    freeMem(dna);
+}
+
+
+struct checkpoint
+/* How far one part of the query file has got, as kept in
+ * <output>.ckpt.<part> for -checkpoint and -resume. */
+{
+    char *fileName;		/* Checkpoint file. */
+    int parts;			/* Number of parts query file is split into. */
+    int queryCount;		/* Number of queries in each part. */
+    long long start;		/* Offset of part in query file. */
+    int done;			/* Number of queries all written to output. */
+    long long inOffset;		/* Offset in query file of next query. */
+    long long outOffset;	/* Size of output for queries done. */
+    time_t lastSave;		/* When checkpoint was last saved. */
+};
+struct checkpoint *checkpoints = NULL;	/* One for each thread with -checkpoint. */
+
+boolean checkpointLoad(struct checkpoint *ck)
+/* Read how far part got from checkpoint file.  Return FALSE if there is
+ * no file. */
+{
+    FILE *f = fopen(ck->fileName, "r");
+    int parts, queryCount;
+    long long start;
+
+    if (f == NULL)
+        return FALSE;
+    if (fscanf(f, "%d %d %lld %d %lld %lld", &parts, &queryCount, &start,
+               &ck->done, &ck->inOffset, &ck->outOffset) != 6)
+        errAbort("%s is not a checkpoint file", ck->fileName);
+    fclose(f);
+    if (parts != ck->parts || queryCount != ck->queryCount || start != ck->start)
+        errAbort("%s is from a run with a different query or number of processes",
+                 ck->fileName);
+    return TRUE;
+}
+
+void checkpointSave(struct checkpoint *ck, FILE *out, struct lineFile *lf)
+/* Flush output to disk, and record that it holds all queries before
+ * the current position of lf.  The checkpoint is written under a
+ * temporary name and renamed, so a crash leaves the previous one. */
+{
+    char tmpPath[PATH_LEN];
+    FILE *f;
+
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+        errnoAbort("Couldn't flush output for %s", ck->fileName);
+    ck->outOffset = ftell(out);
+    ck->inOffset = lf->bufOffsetInFile + lf->lineStart;
+    safef(tmpPath, sizeof(tmpPath), "%s.tmp", ck->fileName);
+    f = mustOpen(tmpPath, "w");
+    fprintf(f, "%d %d %lld %d %lld %lld\n", ck->parts, ck->queryCount, ck->start,
+            ck->done, ck->inOffset, ck->outOffset);
+    carefulClose(&f);
+    if (rename(tmpPath, ck->fileName) < 0)
+        errnoAbort("Couldn't rename %s to %s", tmpPath, ck->fileName);
+    ck->lastSave = time(NULL);
+}
+
+void checkpointInit(struct checkpoint *ck, char *outName, int part, int parts,
+                    int queryCount, long long start, struct lineFile *lf, FILE *out)
+/* Set up checkpoint for one part of query file.  With -resume also move
+ * lf and out on to where the checkpoint says the part had got, or back
+ * to the start of the part if there is no usable checkpoint. */
+{
+    char path[PATH_LEN];
+
+    safef(path, sizeof(path), "%s.ckpt.%d", outName, part);
+    ck->fileName = cloneString(path);
+    ck->parts = parts;
+    ck->queryCount = queryCount;
+    ck->start = start;
+    ck->done = 0;
+    ck->inOffset = start;
+    ck->outOffset = 0;
+    ck->lastSave = time(NULL);
+    if (!resume)
+        return;
+    if (checkpointLoad(ck))
+    {
+        fseek(out, 0, SEEK_END);
+        if (ftell(out) < ck->outOffset)
+        {
+            warn("Output for part %d is shorter than %s says, starting part over",
+                 part, ck->fileName);
+            ck->done = 0;
+            ck->inOffset = start;
+            ck->outOffset = 0;
+        }
+    }
+    if (ftruncate(fileno(out), ck->outOffset) != 0)
+        errnoAbort("Couldn't truncate output for part %d", part);
+    fseek(out, ck->outOffset, SEEK_SET);
+    lineFileSeek(lf, ck->inOffset, SEEK_SET);
+}
+
+FILE *openPartOutput(char *outName, int part, boolean append)
+/* Open output for part of query.  With -resume keep what is already
+ * there, picking it up from where a finished run would have moved it.
+ * With append add to output from an earlier pass over the part. */
+{
+    char path[PATH_LEN], donePath[PATH_LEN];
+    FILE *f;
+
+    if (part == 0)
+        safef(path, sizeof(path), "%s", outName);
+    else
+        safef(path, sizeof(path), "%s.tmp.%d", outName, part);
+    if (append)
+        f = mustOpen(path, "a");
+    else if (!resume)
+        f = mustOpen(path, "w");
+    else
+    {
+        safef(donePath, sizeof(donePath), "%s.%d", outName, part);
+        if (part != 0 && !fileExists(path) && fileExists(donePath))
+            rename(donePath, path);
+        if ((f = fopen(path, "r+")) == NULL)
+            f = mustOpen(path, "w");
+    }
+    /* Write output in big chunks. */
+    if (f != stdout)
+        setvbuf(f, NULL, _IOFBF, outBufSize);
+    return f;
+}
+
+struct queryFile
+/* One query file, and where the parts of it searched on this node start. */
+{
+    char *fileName;		/* Query file. */
+    char *outName;		/* Output, pieced together from each part's. */
+    int queryCount;		/* Number of queries in each part. */
+    long long *offsets;		/* Start of part for each thread. */
+};
+
+char *queryOutName(char *outDir, char *queryFile)
+/* Return name of output in outDir for one of a list of query files: the
+ * query file name without directory or extension, and with the output
+ * format as extension. */
+{
+    char name[FILENAME_LEN], path[PATH_LEN];
+
+    splitPath(queryFile, NULL, name, NULL);
+    safef(path, sizeof(path), "%s/%s.%s", outDir, name, outputFormat);
+    return cloneString(path);
+}
+
+struct queryFile *makeQueryFiles(char **fileNames, int fileCount, char *outName)
+/* Return array of query files.  A single one is output to outName, a list
+ * of them each to a file of its own in the directory outName. */
+{
+    struct queryFile *queryFiles;
+    struct hash *outHash = NULL;
+    int i;
+
+    AllocArray(queryFiles, fileCount);
+    if (fileCount > 1)
+        outHash = hashNew(0);
+    for (i=0; i<fileCount; i++)
+    {
+        struct queryFile *qf = &queryFiles[i];
+        qf->fileName = fileNames[i];
+        if (outHash == NULL)
+            qf->outName = cloneString(outName);
+        else
+        {
+            char *otherFile;
+            qf->outName = queryOutName(outName, qf->fileName);
+            if ((otherFile = hashFindVal(outHash, qf->outName)) != NULL)
+                errAbort("Query files %s and %s would both be output to %s",
+                         otherFile, qf->fileName, qf->outName);
+            hashAdd(outHash, qf->outName, qf->fileName);
+        }
+    }
+    hashFree(&outHash);
+    return queryFiles;
+}
+
+int splitQueryFile(char *fileName, long long *offsets)
+/* Split query file into numproc parts, putting the offset of each in
+ * offsets, and return the number of queries in each part. */
+{
+    unsigned faFastBufSize = 0;
+    DNA *faFastBuf = NULL;
+    struct lineFile *lf = lineFileOpen(fileName, TRUE);
+    int queryCount = 0, cnt, i;
+
+    while (faMixedSpeedReadNext(lf, NULL, NULL, NULL, &faFastBuf, &faFastBufSize))
+        queryCount++;
+    if (numproc > 1)
+        queryCount=queryCount/numproc+1;
+
+    lineFileRewind(lf);
+    offsets[0] = 0;
+    for (i=1; i<numproc; i++)
+    {
+        cnt=queryCount;
+        while (cnt-- && faMixedSpeedReadNext(lf, NULL, NULL, NULL, &faFastBuf, &faFastBufSize));
+        offsets[i] = lf->bufOffsetInFile + lf->lineStart;
+    }
+    lineFileClose(&lf);
+    faFreeFastBuf(&faFastBuf, &faFastBufSize);
+    return queryCount;
+}
+
+void openQueryFile(struct queryFile *qf, boolean append, struct lineFile *lf[], FILE *out[])
+/* Open the parts of query file searched on this node, and their output,
+ * one for each thread.  With append add to output of an earlier pass. */
+{
+    int i;
+    for (i=0; i<threads; i++)
+    {
+        out[i] = openPartOutput(qf->outName, firstPart+i, append);
+        lf[i] = lineFileOpen(qf->fileName, TRUE);
+        lineFileSeek(lf[i], qf->offsets[i], SEEK_SET);
+        if (checkpoints != NULL)
+            checkpointInit(&checkpoints[i], qf->outName, firstPart+i, numproc,
+                           qf->queryCount, qf->offsets[i], lf[i], out[i]);
+    }
+}
+
+void closeQueryFile(struct queryFile *qf, boolean finished, struct lineFile *lf[], FILE *out[])
+/* Close parts of query file opened by openQueryFile.  Once they are
+ * finished, move the output of each part but the first to where rank 0
+ * waits for it to turn up. */
+{
+    char tmpPath[PATH_LEN], path[PATH_LEN];
+    int i;
+    for (i=0; i<threads; i++)
+    {
+        lineFileClose(&lf[i]);
+        carefulClose(&out[i]);
+        if (checkpoints != NULL)
+            freez(&checkpoints[i].fileName);
+    }
+    if (!finished)
+        return;
+    for (i=0; i<threads; i++)
+    {
+        if (firstPart+i == 0)
+            continue;
+        safef(tmpPath, sizeof(tmpPath), "%s.tmp.%d", qf->outName, firstPart+i);
+        safef(path, sizeof(path), "%s.%d", qf->outName, firstPart+i);
+        rename(tmpPath, path);
+    }
+}
+
+boolean mergeParts(char *outName)
+/* Append the output of each part after the first to outName, waiting for
+ * parts that aren't there yet.  Return FALSE if it can't be written. */
+{
+    char buf[1024*64], path[PATH_LEN];
+    FILE *fres = mustOpen(outName, "ab");
+    FILE *ftmp;
+    int i, cnt;
+
+    for (i=1; i<numproc; i++)
+    {
+        safef(path, sizeof(path), "%s.%d", outName, i);
+
+        while((ftmp = fopen(path, "rb")) == NULL)
+            sleep(10);
+
+        while((cnt=fread(buf, 1, sizeof(buf), ftmp))>0)
+        {
+            if (fwrite(buf, 1, cnt, fres) != cnt)
+                return FALSE;
+        }
+        fclose(ftmp);
+        remove(path);
+    }
+    carefulClose(&fres);
+    return TRUE;
+}
+
+struct gfOutput *newOutput(FILE *f)
+/* Return new output controller for the format asked for, writing to f. */
+{
+    struct gfOutput *gvo = gfOutputAny(outputFormat, minIdentity*10, qType == gftProt,
+                                       tType == gftProt, noHead, databaseName,
+                                       databaseSeqCount, databaseLetters, minIdentity, f);
+    if (streamOut)
+        gfOutputStream(gvo);
+    return gvo;
+}
+
+
+struct queryBatch
+/* Queries waiting to be aligned together for -batch. */
+{
+    struct lm *lm;		/* Memory for queries. */
+    struct dnaSeq **seqs;	/* Queries, batchSize of them allocated. */
+    Bits **masks;		/* Query masks, or NULLs. */
+    int count;			/* Number of queries in batch. */
+};
+
+void batchAdd(struct queryBatch *qb, struct dnaSeq *seq, struct genoFind *gf,
+              long long *retTotalSize, int *retCount)
+/* Copy seq into batch, doing what searchOneMaskTrim does before
+ * searching. */
+{
+    boolean maskQuery = (qMask != NULL);
+    boolean lcMask = (qMask != NULL && sameWord(qMask, "lower"));
+    struct dnaSeq *copy, trimmedSeq;
+    lmAllocVar(qb->lm, copy);
+    copy->name = lmCloneString(qb->lm, seq->name);
+    copy->dna = lmCloneStringZ(qb->lm, seq->dna, seq->size);
+    copy->size = seq->size;
+    *retTotalSize += seq->size;
+    *retCount += 1;
+    dotOut();
+    if (preScreen && !gfQueryMayHit(gf, copy))
+    {
+        /* Keep its place in the output, with nothing to align. */
+        copy->size = 0;
+        qb->masks[qb->count] = NULL;
+    }
+    else
+    {
+        qb->masks[qb->count] = maskQuerySeq(copy, FALSE, maskQuery, lcMask);
+        trimSeq(copy, &trimmedSeq);
+        *copy = trimmedSeq;
+        if (qType == gftRna || qType == gftRnaX)
+            memSwapChar(copy->dna, copy->size, 'u', 't');
+    }
+    qb->seqs[qb->count++] = copy;
+}
+
+void batchFlush(struct queryBatch *qb, struct genoFind *gf, FILE *outFile,
+                struct gfOutput *gvo)
+/* Align and write out queries in batch, and empty it. */
+{
+    int i;
+    if (qb->count == 0)
+        return;
+    gfShortDnaBatchInMem(qb->seqs, qb->masks, qb->count, gf, minScore, gvo, outFile, fastMap);
+    for (i=0; i<qb->count; i++)
+        bitFree(&qb->masks[i]);
+    qb->count = 0;
+    lmReset(qb->lm);
+}
+
+void searchFaBatched(struct lineFile *lf, int queryCount, struct genoFind *gf,
+                     FILE *outFile, struct hash *maskHash,
+                     long long *retTotalSize, int *retCount,
+                     struct gfOutput *gvo, struct checkpoint *ck)
+/* Search DNA queries in lf batchSize at a time.  Checkpoints are only
+ * saved between batches, when all queries read have been written out. */
+{
+    struct queryBatch qb;
+    struct dnaSeq seq;
+    unsigned faFastBufSize = 0;
+    DNA *faFastBuf = NULL;
+
+    ZeroVar(&qb);
+    qb.lm = lmInit(0);
+    AllocArray(qb.seqs, batchSize);
+    AllocArray(qb.masks, batchSize);
+    gvo->maskHash = maskHash;
+    seq.name=(char*)malloc(sizeof(char)*512);
+    while (queryCount-- && faMixedSpeedReadNext(lf, &seq.dna, &seq.size, &seq.name, &faFastBuf, &faFastBufSize))
+    {
+        if (seq.size > MAXSINGLEPIECESIZE)
+        {
+            batchFlush(&qb, gf, outFile, gvo);
+            searchOneMaskTrim(&seq, FALSE, gf, outFile, maskHash, retTotalSize, retCount, gvo);
+        }
+        else
+        {
+            batchAdd(&qb, &seq, gf, retTotalSize, retCount);
+            if (qb.count == batchSize)
+                batchFlush(&qb, gf, outFile, gvo);
+        }
+        if (ck != NULL)
+        {
+            ck->done += 1;
+            if (qb.count == 0 && time(NULL) - ck->lastSave >= checkpointEvery)
+                checkpointSave(ck, outFile, lf);
+        }
+    }
+    batchFlush(&qb, gf, outFile, gvo);
+    if (ck != NULL)
+        checkpointSave(ck, outFile, lf);
+    free(seq.name);
+    faFreeFastBuf(&faFastBuf, &faFastBufSize);
+    freeMem(qb.seqs);
+    freeMem(qb.masks);
+    lmCleanup(&qb.lm);
+}
+
 void* performSearch(void* args)
 {
     int             id=*((int*)(((void**)args)[0]));
@@ -349,9 +1140,14 @@ void* performSearch(void* args)
 
     unsigned faFastBufSize = 0;
     DNA *faFastBuf = NULL;
+    struct checkpoint *ck = NULL;
 
 
-    if (myid==0 && id==0)
+    if (bindThreads)
+        numaBindThread(id % numaNodeCount());
+    if (checkpoints != NULL)
+        ck = &checkpoints[id];
+    if (myid==0 && id==0 && (ck == NULL || ck->outOffset == 0))
         gfOutputHead(gvo, outFile);
 //for (i=0; i<queryCount; ++i)
     {
@@ -365,8 +1161,8 @@ void* performSearch(void* args)
             seq = nibLoadAllMasked(NIB_MASK_MIXED, fileName);
             freez(&seq->name);
             seq->name = cloneString(fileName);
-            searchOneMaskTrim(seq, isProt, gf, outFile,
-                              maskHash, &totalSize, &count, gvo);
+            searchOneCached(seq, isProt, gf, outFile,
+                            maskHash, &totalSize, &count, gvo);
             freeDnaSeq(&seq);
         }
         else if (twoBitIsSpec(fileName))
@@ -383,8 +1179,8 @@ void* performSearch(void* args)
                 {
                     struct dnaSeq *seq = twoBitReadSeqFrag(tbf, ss->name,
                                                            ss->start, ss->end);
-                    searchOneMaskTrim(seq, isProt, gf, outFile,
-                                      maskHash, &totalSize, &count, gvo);
+                    searchOneCached(seq, isProt, gf, outFile,
+                                    maskHash, &totalSize, &count, gvo);
                     dnaSeqFree(&seq);
                 }
             }
@@ -394,22 +1190,39 @@ void* performSearch(void* args)
                 for (index = tbf->indexList; index != NULL; index = index->next)
                 {
                     struct dnaSeq *seq = twoBitReadSeqFrag(tbf, index->name, 0, 0);
-                    searchOneMaskTrim(seq, isProt, gf, outFile,
-                                      maskHash, &totalSize, &count, gvo);
+                    searchOneCached(seq, isProt, gf, outFile,
+                                    maskHash, &totalSize, &count, gvo);
                     dnaSeqFree(&seq);
                 }
             }
             twoBitClose(&tbf);
         }
+        else if (batchSize > 0 && !isProt)
+        {
+            if (ck != NULL)
+                queryCount -= ck->done;
+            searchFaBatched(lf, queryCount, gf, outFile, maskHash,
+                            &totalSize, &count, gvo, ck);
+        }
         else
         {
             struct dnaSeq seq;
+            if (ck != NULL)
+                queryCount -= ck->done;
             seq.name=(char*)malloc(sizeof(char)*512);
             while (queryCount-- && faMixedSpeedReadNext(lf, &seq.dna, &seq.size, &seq.name, &faFastBuf, &faFastBufSize))
             {
-                searchOneMaskTrim(&seq, isProt, gf, outFile,
-                                  maskHash, &totalSize, &count, gvo);
+                searchOneCached(&seq, isProt, gf, outFile,
+                                maskHash, &totalSize, &count, gvo);
+                if (ck != NULL)
+                {
+                    ck->done += 1;
+                    if (time(NULL) - ck->lastSave >= checkpointEvery)
+                        checkpointSave(ck, outFile, lf);
+                }
             }
+            if (ck != NULL)
+                checkpointSave(ck, outFile, lf);
             free(seq.name);
             faFreeFastBuf(&faFastBuf, &faFastBufSize);
         }
@@ -418,45 +1231,80 @@ void* performSearch(void* args)
         printf("Searched %lld bases in %d sequences\n", totalSize, count);
 }
 
-void searchOneIndex(int fileCount, char *files[], struct lineFile *lf[], struct genoFind *gf,
-                    boolean isProt, struct hash *maskHash, FILE *out[], struct gfOutput *gvo[],
-                    boolean showStatus)
+void searchOneIndex(struct queryFile *queryFiles, int fileCount, struct genoFind *gf,
+                    boolean isProt, struct hash *maskHash, boolean showStatus)
 /* Search all sequences in all files against single genoFind index. */
 {
-    int        i;
+    int        i, fileIx;
     pthread_t* thd=(pthread_t*)malloc(sizeof(pthread_t)*threads);
     void***    args=(void***)malloc(sizeof(void*)*threads);
     int*       id=(int*)malloc(sizeof(int)*threads);
-
-    for (i=0; i<threads; i++)
+    int        nodeCount = 1;
+    struct genoFind **nodeGf;
+    struct lineFile **lf = (struct lineFile **)malloc(sizeof(struct lineFile *)*threads);
+    FILE       **out = (FILE **)malloc(sizeof(FILE *)*threads);
+    struct gfOutput **gvo = (struct gfOutput **)malloc(sizeof(struct gfOutput *)*threads);
+
+    /* With replication each NUMA node gets its own copy of the index,
+     * and threads, which are bound to nodes round robin, use the copy
+     * on their node. */
+    if (numaPolicy != NULL && sameString(numaPolicy, "replicate"))
+        nodeCount = numaNodeCount();
+    nodeGf = (struct genoFind **)malloc(sizeof(struct genoFind *)*nodeCount);
+    nodeGf[0] = gf;
+    for (i=1; i<nodeCount; i++)
+        nodeGf[i] = gfReplicateIndex(gf, i);
+    if (dedupQueries)
+        dedupHash = hashNew(16);
+
+    /* Query files are searched one after another, each split between all
+     * threads of all processes. */
+    for (fileIx=0; fileIx<fileCount; fileIx++)
     {
-        args[i]=(void**)malloc(sizeof(void*)*10);
-        args[i][1]=&fileCount;
-        args[i][2]=files;
-        args[i][4]=gf;
-        args[i][5]=&isProt;
-        args[i][6]=maskHash;
-        args[i][8]=&showStatus;
-
-        id[i]=i;
-        args[i][0]=&(id[i]);
-        args[i][3]=lf[i];
-        args[i][7]=out[i];
-        args[i][9]=gvo[i];
-        if (pthread_create(&(thd[i]), NULL, performSearch, (void*)(args[i])) != 0)
+        struct queryFile *qf = &queryFiles[fileIx];
+        openQueryFile(qf, FALSE, lf, out);
+        for (i=0; i<threads; i++)
         {
-            printf("Failed to create threads\n");
-            return;
+            gvo[i] = newOutput(out[i]);
+            args[i]=(void**)malloc(sizeof(void*)*10);
+            args[i][1]=&qf->queryCount;
+            args[i][2]=&qf->fileName;
+            args[i][4]=nodeGf[i % nodeCount];
+            args[i][5]=&isProt;
+            args[i][6]=maskHash;
+            args[i][8]=&showStatus;
+
+            id[i]=i;
+            args[i][0]=&(id[i]);
+            args[i][3]=lf[i];
+            args[i][7]=out[i];
+            args[i][9]=gvo[i];
+            if (pthread_create(&(thd[i]), NULL, performSearch, (void*)(args[i])) != 0)
+            {
+                printf("Failed to create threads\n");
+                return;
+            }
         }
-    }
 
-    for (i=0; i<threads; i++)
-        pthread_join(thd[i], NULL);
+        for (i=0; i<threads; i++)
+            pthread_join(thd[i], NULL);
+        for (i=0; i<threads; i++)
+        {
+            free(args[i]);
+            gfOutputFree(&gvo[i]);
+        }
+        closeQueryFile(qf, TRUE, lf, out);
+    }
+    for (i=1; i<nodeCount; i++)
+        genoFindFree(&nodeGf[i]);
+    hashFreeWithVals(&dedupHash, freeDedupQuery);
+    free(nodeGf);
     free(thd);
-    for (i=0; i<threads; i++)
-        free(args[i]);
     free(args);
     free(id);
+    free(lf);
+    free(out);
+    free(gvo);
 }
 
 struct trans3 *seqListToTrans3List(struct dnaSeq *seqList, aaSeq *transLists[3], struct hash **retHash)
@@ -534,6 +1382,8 @@ void* performBigblat(void* args)
     DNA             *faFastBuf = NULL;
 
     ZeroVar(&trimmedSeq);
+    if (bindThreads)
+        numaBindThread(id % numaNodeCount());
 //for (i=0; i<queryCount; ++i)
     {
         aaSeq qSeq;
@@ -570,11 +1420,11 @@ void* performBigblat(void* args)
     }
 }
 
-void bigBlat(struct dnaSeq *untransList, int queryCount, char *queryFiles[], struct lineFile *lf[], boolean transQuery,
-             boolean qIsDna, FILE *out[], struct gfOutput *gvo[], boolean showStatus)
+void bigBlat(struct dnaSeq *untransList, struct queryFile *queryFiles, int fileCount, boolean transQuery,
+             boolean qIsDna, boolean showStatus)
 /* Run query against translated DNA database (3 frames on each strand). */
 {
-    int             frame, i;
+    int             frame, i, fileIx;
     struct dnaSeq   *seq;
     struct genoFind *gfs[3];
     aaSeq           *dbSeqLists[3];
@@ -589,11 +1439,10 @@ void bigBlat(struct dnaSeq *untransList, int queryCount, char *queryFiles[], str
     pthread_t*      thd = (pthread_t*)malloc(sizeof(pthread_t)*threads);
     void***         args = (void***)malloc(sizeof(void*)*threads);
     int*            id = (int*)malloc(sizeof(int)*threads);
-    off_t*          offset = (off_t*)malloc(sizeof(off_t)*threads);
-
-
-    if (showStatus)
-        printf("Blatx %d sequences in database, %d sequences in each query\n", slCount(untransList), queryCount);
+    struct lineFile **lf = (struct lineFile **)malloc(sizeof(struct lineFile *)*threads);
+    FILE            **out = (FILE **)malloc(sizeof(FILE *)*threads);
+    /* Output controllers for each thread of each file, kept for both strands. */
+    struct gfOutput **fileGvo = (struct gfOutput **)malloc(sizeof(struct gfOutput *)*threads*fileCount);
 
     /* Figure out how to manage query case.  Proteins want to be in
      * upper case, generally, nucleotides in lower case.  But there
@@ -613,12 +1462,6 @@ void bigBlat(struct dnaSeq *untransList, int queryCount, char *queryFiles[], str
         forceUpper = TRUE;
     }
 
-    if (gvo[0]->fileHead != NULL)
-        gvo[0]->fileHead(gvo[0], out[0]);
-
-    for (i=0; i<threads; i++)
-        offset[i] = lineFileTell(lf[i]);
-
     for (isRc = FALSE; isRc <= 1; ++isRc)
     {
         /* Initialize local pointer arrays to NULL to prevent surprises. */
@@ -635,39 +1478,72 @@ void bigBlat(struct dnaSeq *untransList, int queryCount, char *queryFiles[], str
                                     repMatch, ooc, TRUE, oneOff, FALSE, stepSize);
         }
 
-        /* multi-threads */
-        for (i=0; i<threads; i++)
+        /* Query files are searched one after another, each split between
+         * all threads of all processes.  The second strand adds to the
+         * output of the first. */
+        for (fileIx=0; fileIx<fileCount; fileIx++)
         {
-            args[i]=(void**)malloc(sizeof(void*)*15);
-            args[i][1]=&queryCount;
-            args[i][2]=queryFiles;
-            args[i][4]=gfs;
-            args[i][5]=t3Hash;
-            args[i][6]=&isRc;
-            args[i][7]=&qIsDna;
-
-            args[i][9]=&transQuery;
-            args[i][10]=&forceLower;
-            args[i][11]=&forceUpper;
-            args[i][12]=&maskUpper;
-            args[i][13]=&toggle;
+            struct queryFile *qf = &queryFiles[fileIx];
+            struct gfOutput **gvo = fileGvo + fileIx*threads;
+            openQueryFile(qf, isRc, lf, out);
+            if (!isRc)
+            {
+                if (showStatus)
+                    printf("Blatx %d sequences in database, %d sequences in each query\n",
+                           slCount(untransList), qf->queryCount);
+                for (i=0; i<threads; i++)
+                    gvo[i] = newOutput(out[i]);
+                /* Only the first part gets a header, as the parts are
+                 * pieced together after. */
+                if (myid == 0)
+                    gfOutputHead(gvo[0], out[0]);
+            }
+            else
+            {
+                for (i=0; i<threads; i++)
+                    gfOutputSetFile(gvo[i], out[i]);
+            }
 
-            id[i]=i;
-            args[i][0]=&(id[i]);
-            args[i][3]=lf[i];
-            args[i][8]=out[i];
-            args[i][14]=gvo[i];
-            if (pthread_create(&(thd[i]), NULL, performBigblat, (void*)(args[i])) != 0)
+            /* multi-threads */
+            for (i=0; i<threads; i++)
             {
-                printf("Failed to create threads\n");
-                return;
+                args[i]=(void**)malloc(sizeof(void*)*15);
+                args[i][1]=&qf->queryCount;
+                args[i][2]=&qf->fileName;
+                args[i][4]=gfs;
+                args[i][5]=t3Hash;
+                args[i][6]=&isRc;
+                args[i][7]=&qIsDna;
+
+                args[i][9]=&transQuery;
+                args[i][10]=&forceLower;
+                args[i][11]=&forceUpper;
+                args[i][12]=&maskUpper;
+                args[i][13]=&toggle;
+
+                id[i]=i;
+                args[i][0]=&(id[i]);
+                args[i][3]=lf[i];
+                args[i][8]=out[i];
+                args[i][14]=gvo[i];
+                if (pthread_create(&(thd[i]), NULL, performBigblat, (void*)(args[i])) != 0)
+                {
+                    printf("Failed to create threads\n");
+                    return;
+                }
             }
-        }
 
-        for (i=0; i<threads; i++)
-            pthread_join(thd[i], NULL);
-        for (i=0; i<threads; i++)
-            free(args[i]);
+            for (i=0; i<threads; i++)
+                pthread_join(thd[i], NULL);
+            for (i=0; i<threads; i++)
+                free(args[i]);
+            if (isRc)
+            {
+                for (i=0; i<threads; i++)
+                    gfOutputFree(&gvo[i]);
+            }
+            closeQueryFile(qf, isRc, lf, out);
+        }
 
 
         /* Clean up time. */
@@ -682,37 +1558,200 @@ void bigBlat(struct dnaSeq *untransList, int queryCount, char *queryFiles[], str
         {
             reverseComplement(seq->dna, seq->size);
         }
-
-        /* Rewind each input file pointer for RC run */
-        if (isRc == FALSE)
-        {
-            for (i=0; i<threads; i++)
-                lineFileSeek(lf[i], offset[i], SEEK_SET);
-        }
     }
 
     free(thd);
     free(args);
     free(id);
-    free(offset);
+    free(lf);
+    free(out);
+    free(fileGvo);
 }
 
 
-void blat(char *dbFile, int queryCount, char **queryFiles, struct lineFile **lf, FILE *out[])
-/* blat - Standalone BLAT fast sequence search command line tool. */
+void md5AddFile(hts_md5_context *md5, char *fileName)
+/* Add contents of file to md5. */
+{
+    FILE *f = mustOpen(fileName, "rb");
+    char buf[64*1024];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof(buf), f)) > 0)
+        hts_md5_update(md5, buf, size);
+    if (ferror(f))
+        errnoAbort("Couldn't read %s", fileName);
+    carefulClose(&f);
+}
+
+void makeCacheFingerprint(struct dnaSeq *dbSeqList)
+/* Set cacheFingerprint to md5 of program version, options that may
+ * change output, and database sequence, including its masking.  For
+ * options naming a file, the contents of the file are used rather than
+ * its name, so a file made again under the same name isn't mistaken for
+ * the old one.  Mask and repeat files show up in the database sequence
+ * case. */
+{
+    static char *ignored[] = {"noHead", "dots", "numa", "bindThreads", "hugePages",
+                              "packIndex", "slabAlloc", "dedupQueries", "resultCache",
+                              "checkpoint", "resume", "bcastDb"};
+    static char *fileValued[] = {"ooc", "sufa"};
+    hts_md5_context *md5 = hts_md5_init();
+    struct optionSpec *opt;
+    struct dnaSeq *seq;
+    unsigned char digest[16];
+    char hex[33], buf[64];
+
+    if (md5 == NULL)
+        errAbort("Out of memory making md5 context");
+    hts_md5_update(md5, gfVersion, strlen(gfVersion));
+    for (opt = options; opt->name != NULL; opt++)
+    {
+        char *val = optionVal(opt->name, NULL);
+        if (val == NULL || stringArrayIx(opt->name, ignored, ArraySize(ignored)) >= 0)
+            continue;
+        hts_md5_update(md5, opt->name, strlen(opt->name) + 1);
+        if (stringArrayIx(opt->name, fileValued, ArraySize(fileValued)) >= 0)
+            md5AddFile(md5, val);
+        else
+            hts_md5_update(md5, val, strlen(val) + 1);
+    }
+    for (seq = dbSeqList; seq != NULL; seq = seq->next)
+    {
+        safef(buf, sizeof(buf), "%d", seq->size);
+        hts_md5_update(md5, seq->name, strlen(seq->name) + 1);
+        hts_md5_update(md5, buf, strlen(buf) + 1);
+        hts_md5_update(md5, seq->dna, seq->size);
+    }
+    hts_md5_final(digest, md5);
+    hts_md5_destroy(md5);
+    hts_md5_hex(hex, digest);
+    cacheFingerprint = cloneString(hex);
+}
+
+struct dnaSeq *loadDatabase(char *dbFile, boolean showStatus)
+/* Read database sequences from file or list of files. */
+{
+    char **dbFiles;
+    int dbCount;
+
+    gfClientFileArray(dbFile, &dbFiles, &dbCount);
+    return gfClientSeqList(dbCount, dbFiles, tType == gftProt, tType == gftDnaX, repeats,
+                           minRepDivergence, showStatus);
+}
+
+struct dnaSeq *bcastDatabase(char *dbFile, MPI_Comm comm, boolean showStatus)
+/* Have rank 0 of comm read the database, and send it to the others over
+ * MPI, so the file is only read once however many nodes there are.  The
+ * names and sizes are sent first, and then the sequence in chunks of up
+ * to bcastChunkSize, filling in the sequences one after the other. */
+{
+    enum {bcastChunkSize = 64*1024*1024};
+    struct dnaSeq *seqList = NULL, *seq;
+    struct dnaSeq **seqs;
+    int rank, seqCount = 0, namesSize = 0;
+    int *sizes;
+    char *names, *name, *chunk;
+    int seqIx = 0, seqOff = 0;
+    int i;
+
+    MPI_Comm_rank(comm, &rank);
+    if (rank == 0)
+    {
+        seqList = loadDatabase(dbFile, showStatus);
+        seqCount = slCount(seqList);
+        for (seq = seqList; seq != NULL; seq = seq->next)
+            namesSize += strlen(seq->name) + 1;
+    }
+    MPI_Bcast(&seqCount, 1, MPI_INT, 0, comm);
+    MPI_Bcast(&namesSize, 1, MPI_INT, 0, comm);
+    AllocArray(sizes, seqCount);
+    names = needLargeMem(namesSize);
+    if (rank == 0)
+    {
+        for (seq = seqList, name = names, i = 0; seq != NULL; seq = seq->next, ++i)
+        {
+            sizes[i] = seq->size;
+            strcpy(name, seq->name);
+            name += strlen(name) + 1;
+        }
+    }
+    MPI_Bcast(sizes, seqCount, MPI_INT, 0, comm);
+    MPI_Bcast(names, namesSize, MPI_CHAR, 0, comm);
+    if (rank != 0)
+    {
+        for (i = 0, name = names; i < seqCount; ++i, name += strlen(name) + 1)
+        {
+            AllocVar(seq);
+            seq->name = cloneString(name);
+            seq->size = sizes[i];
+            seq->dna = needHugeMem(seq->size + 1);
+            seq->dna[seq->size] = 0;
+            slAddHead(&seqList, seq);
+        }
+        slReverse(&seqList);
+    }
+    freeMem(names);
+    freeMem(sizes);
+
+    /* Stream the bases through a chunk buffer. */
+    AllocArray(seqs, seqCount);
+    for (seq = seqList, i = 0; seq != NULL; seq = seq->next, ++i)
+        seqs[i] = seq;
+    chunk = needLargeMem(bcastChunkSize);
+    while (seqIx < seqCount)
+    {
+        int chunkSize = 0;
+        int startIx = seqIx, startOff = seqOff;
+        /* Work out how much goes in chunk, and copy it there if sending. */
+        while (seqIx < seqCount && chunkSize < bcastChunkSize)
+        {
+            int n = min(seqs[seqIx]->size - seqOff, bcastChunkSize - chunkSize);
+            if (rank == 0)
+                memcpy(chunk + chunkSize, seqs[seqIx]->dna + seqOff, n);
+            chunkSize += n;
+            seqOff += n;
+            if (seqOff == seqs[seqIx]->size)
+            {
+                ++seqIx;
+                seqOff = 0;
+            }
+        }
+        MPI_Bcast(chunk, chunkSize, MPI_CHAR, 0, comm);
+        if (rank != 0)
+        {
+            /* Copy chunk out to the same places. */
+            int pos = 0;
+            while (pos < chunkSize)
+            {
+                int n = min(seqs[startIx]->size - startOff, chunkSize - pos);
+                memcpy(seqs[startIx]->dna + startOff, chunk + pos, n);
+                pos += n;
+                startOff += n;
+                if (startOff == seqs[startIx]->size)
+                {
+                    ++startIx;
+                    startOff = 0;
+                }
+            }
+        }
+    }
+    freeMem(chunk);
+    freeMem(seqs);
+    return seqList;
+}
+
+void blat(char *dbFile, struct dnaSeq *dbSeqList, struct queryFile *queryFiles, int queryFileCount)
+/* blat - Standalone BLAT fast sequence search command line tool.  Reads
+ * database unless dbSeqList is already loaded. */
 {
     char **dbFiles;
     int dbCount;
-    struct dnaSeq *dbSeqList, *seq;
+    struct dnaSeq *seq;
     struct genoFind *gf;
     boolean tIsProt = (tType == gftProt);
     boolean qIsProt = (qType == gftProt);
     boolean bothSimpleNuc = (tType == gftDna && (qType == gftDna || qType == gftRna));
     boolean bothSimpleProt = (tIsProt && qIsProt);
-    boolean showStatus = (out[0] != stdout);
-    /* Stuff to support various output formats. */
-    struct gfOutput **gvo;		/* output controller */
-    int i;
+    boolean showStatus = !sameString(queryFiles[0].outName, "stdout");
 
     databaseName = dbFile;
     gfClientFileArray(dbFile, &dbFiles, &dbCount);
@@ -724,19 +1763,13 @@ void blat(char *dbFile, int queryCount, char **queryFiles, struct lineFile **lf,
         exit(0);
     }
 
-    dbSeqList = gfClientSeqList(dbCount, dbFiles, tIsProt, tType == gftDnaX, repeats,
-                                minRepDivergence, showStatus);
+    if (dbSeqList == NULL)
+        dbSeqList = loadDatabase(dbFile, showStatus);
     databaseSeqCount = slCount(dbSeqList);
     for (seq = dbSeqList; seq != NULL; seq = seq->next)
         databaseLetters += seq->size;
-
-
-    gvo = (struct gfOutput **)malloc(sizeof(struct gfOutput *) * threads);
-    for (i=0; i<threads; i++)
-    {
-        gvo[i] = gfOutputAny(outputFormat, minIdentity*10, qIsProt, tIsProt, noHead,
-                             databaseName, databaseSeqCount, databaseLetters, minIdentity, out[i]);
-    }
+    if (resultCache != NULL)
+        makeCacheFingerprint(dbSeqList);
 
 
     if (bothSimpleNuc || bothSimpleProt)
@@ -751,6 +1784,7 @@ void blat(char *dbFile, int queryCount, char **queryFiles, struct lineFile **lf,
             {
                 Bits *maskedBits = maskFromUpperCaseSeq(seq);
                 hashAdd(maskHash, seq->name, maskedBits);
+                seq->mask = maskedBits;
             }
         }
 
@@ -765,16 +1799,16 @@ void blat(char *dbFile, int queryCount, char **queryFiles, struct lineFile **lf,
         if (mask != NULL)
             gfClientUnmask(dbSeqList);
 
-        searchOneIndex(queryCount, queryFiles, lf, gf, tIsProt, maskHash, out, gvo, showStatus);
+        searchOneIndex(queryFiles, queryFileCount, gf, tIsProt, maskHash, showStatus);
         freeHash(&maskHash);
     }
     else if (tType == gftDnaX && qType == gftProt)
     {
-        bigBlat(dbSeqList, queryCount, queryFiles, lf, FALSE, TRUE, out, gvo, showStatus);
+        bigBlat(dbSeqList, queryFiles, queryFileCount, FALSE, TRUE, showStatus);
     }
     else if (tType == gftDnaX && (qType == gftDnaX || qType == gftRnaX))
     {
-        bigBlat(dbSeqList, queryCount, queryFiles, lf, TRUE, qType == gftDnaX, out, gvo, showStatus);
+        bigBlat(dbSeqList, queryFiles, queryFileCount, TRUE, qType == gftDnaX, showStatus);
     }
     else
     {
@@ -783,32 +1817,6 @@ void blat(char *dbFile, int queryCount, char **queryFiles, struct lineFile **lf,
     if (dotEvery > 0)
         printf("\n");
     freeDnaSeqList(&dbSeqList);
-    free(gvo);
-}
-
-
-struct ranknode
-{
-    int rank;
-    struct ranknode *next;
-};
-
-struct headnode
-{
-    char nodename[MPI_MAX_PROCESSOR_NAME];
-    struct ranknode *rlist;
-    struct headnode *next;
-};
-
-
-
-struct headnode *findNode(struct headnode *nodelist, char *name)
-{
-    struct headnode *p;
-    for (p=nodelist; p!=NULL; p=p->next)
-        if (strcmp(p->nodename, name) == 0)
-            break;
-    return p;
 }
 
 
@@ -817,28 +1825,19 @@ int main(int argc, char *argv[])
 {
     boolean tIsProtLike, qIsProtLike;
     char buf[1024*64];
-    char **queryFiles;
-    FILE **out;
-    FILE *fres;
-    FILE *ftmp;
-    struct lineFile **lf;
-    int  queryCount;
-    int  i, cnt, tmp;
-
-    unsigned faFastBufSize = 0;
-    DNA      *faFastBuf = NULL;
-    
-    int  chooseid, numproc;
-    int  namelen, provided;
-    char nodename[MPI_MAX_PROCESSOR_NAME];
-    char namebuf[1024*64];
-    struct headnode *nodelist;
-    struct headnode *pn;
-    struct headnode *pnt;
-    struct ranknode *pr;
-    struct ranknode *prt;
-    int    base;
-    long long int   *offsets;
+    char **queryFileNames;
+    struct queryFile *queryFiles;
+    int  queryFileCount;
+    int  i, tmp;
+
+    int  nodeRank;
+    int  provided;
+    MPI_Comm nodeComm;
+    MPI_Comm leaderComm;
+    long long int   *allOffsets = NULL;
+    struct dnaSeq   *dbSeqList = NULL;
+    int    *partCounts = NULL;
+    int    *partStarts = NULL;
     
 
 
@@ -848,93 +1847,32 @@ int main(int argc, char *argv[])
         MPI_Abort(MPI_COMM_WORLD, 1);
     MPI_Comm_rank(MPI_COMM_WORLD, &myid);
     MPI_Comm_size(MPI_COMM_WORLD, &numproc);
-    MPI_Get_processor_name(nodename, &namelen);
     
-    if (myid != 0)
-    {
-        /* For non master process, send its node name
-         * to master process */
-        MPI_Send(nodename, namelen+1, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
-        
-        MPI_Recv(&chooseid, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        
-        if (chooseid == myid)
-        {
-            MPI_Recv(&threads, 1, MPI_INT, 0, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            MPI_Recv(&base,    1, MPI_INT, 0, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        else
-        {
-            MPI_Finalize();
-            return 0;
-        }
+    /* Combine the processes on each node into the first of them, the node
+     * leader, which runs one thread for each.  This minimizes memory usage
+     * per node.  Leaders are ordered by rank, so rank 0 leads the first
+     * node, and each gets the parts of the query from firstPart on. */
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &threads);
+    MPI_Comm_free(&nodeComm);
+    MPI_Comm_split(MPI_COMM_WORLD, nodeRank == 0 ? 0 : MPI_UNDEFINED, myid, &leaderComm);
+    if (nodeRank != 0)
+    {
+        MPI_Finalize();
+        return 0;
     }
-    else
+    firstPart = 0;
+    MPI_Exscan(&threads, &firstPart, 1, MPI_INT, MPI_SUM, leaderComm);
+    if (myid == 0)
     {
-        /* for MASTER process, identify different nodes and combine
-         * multiple processes in the same node into one process using
-         * multiple threads. This would minimize the memory usages per
-         * node */
-        nodelist = (struct headnode *)malloc(sizeof(struct headnode));
-        strcpy(nodelist->nodename, nodename);
-        nodelist->next  = NULL;
-        nodelist->rlist = (struct ranknode *)malloc(sizeof(struct ranknode));
-        nodelist->rlist->rank = 0;
-        nodelist->rlist->next = NULL;
-        
-        for (i=1; i<numproc; i++)
-        {
-            MPI_Recv(namebuf, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, i, 0,
-                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            
-            pn = findNode(nodelist, namebuf);
-            if (pn == NULL)
-            {
-                for (pn=nodelist;pn->next!=NULL;pn=pn->next);
-                pn->next = (struct headnode *)malloc(sizeof(struct headnode));
-                pn=pn->next;
-                strcpy(pn->nodename, namebuf);
-                pn->next  = NULL;
-                pn->rlist = (struct ranknode *)malloc(sizeof(struct ranknode));
-                pn->rlist->rank = i;
-                pn->rlist->next = NULL;
-            }
-            else
-            {
-                for (pr=pn->rlist;pr->next!=NULL;pr=pr->next);
-                pr->next = (struct ranknode *)malloc(sizeof(struct ranknode));
-                pr = pr->next;
-                pr->rank = i;
-                pr->next = NULL;
-            }
-        }
-        
-        /* send the first rank in each node list to all the processes in this node
-         * and send number of threads to the first process in each node */
-        tmp = 0;
-        for (pn=nodelist; pn!=NULL; pn=pn->next)
-        {
-            cnt = 0;
-            chooseid = pn->rlist->rank;
-            for (pr=pn->rlist; pr!=NULL; pr=pr->next)
-            {
-                if (pr->rank != 0)
-                    MPI_Send(&chooseid, 1, MPI_INT, pr->rank, 1, MPI_COMM_WORLD);
-                cnt++;
-            }
-            if (chooseid != 0)
-            {
-                MPI_Send(&cnt, 1, MPI_INT, chooseid, 2, MPI_COMM_WORLD);
-                MPI_Send(&tmp, 1, MPI_INT, chooseid, 3, MPI_COMM_WORLD);
-            }
-            else
-            {
-                threads = cnt;
-                base    = 0;
-            }
-            tmp += cnt;
-        }
+        firstPart = 0;
+        MPI_Comm_size(leaderComm, &tmp);
+        partCounts = (int *)malloc(sizeof(int) * tmp);
+        partStarts = (int *)malloc(sizeof(int) * tmp);
     }
+    MPI_Gather(&threads, 1, MPI_INT, partCounts, 1, MPI_INT, 0, leaderComm);
+    MPI_Gather(&firstPart, 1, MPI_INT, partStarts, 1, MPI_INT, 0, leaderComm);
     
     
     /* Verify threads number */
@@ -954,6 +1892,8 @@ int main(int argc, char *argv[])
     optionInit(&argc, argv, options);
     if (argc != 4)
         usage();
+    if (optionExists("slabAlloc"))
+        pushSlabMemHandler();
 
     /* Get database and query sequence types and make sure they are
      * legal and compatable. */
@@ -1060,166 +2000,217 @@ int main(int argc, char *argv[])
         repeats = mask;
     outputFormat = optionVal("out", outputFormat);
     dotEvery = optionInt("dots", 0);
-    /* set global for fuzzy find functions */
-    setFfIntronMax(optionInt("maxIntron", ffIntronMaxDefault));
-    setFfExtendThroughN(optionExists("extendThroughN"));  
-    
-
-    gfClientFileArray(argv[2], &queryFiles, &queryCount);
-    if (queryCount > 1)
-    {
-        MPI_Finalize();
-        errAbort("pblat does not support using list of file names as query. Please query each of the input files separately.");
-    }
-
-
-    out=(FILE**)malloc(sizeof(FILE*) * threads);
-    for (i=0; i<threads; i++)
+    numaPolicy = optionVal("numa", NULL);
+    if (numaPolicy != NULL)
     {
-        if (base + i == 0)
-            strcpy(buf, argv[3]);
-        else
-            sprintf(buf, "%s.tmp.%d", argv[3], base+i);
-        out[i] = mustOpen(buf, "w");
+        if (sameString(numaPolicy, "interleave"))
+            gfSetNumaInterleave(TRUE);
+        else if (!sameString(numaPolicy, "replicate"))
+        {
+            MPI_Finalize();
+            errAbort("Unrecognized -numa=%s, must be interleave or replicate", numaPolicy);
+        }
     }
-
-    
-    lf=(struct lineFile **)malloc(sizeof(struct lineFile *) * threads);
-    if (myid == 0)
+    gfSetHugePages(optionVal("hugePages", NULL));
+    gfSetPackedIndex(optionExists("packIndex"));
+    if (optionExists("spacedSeed"))
     {
-        /* get number of lines that each process/thread should process */      
-        queryCount=0;
-        struct lineFile *tlf = lineFileOpen(queryFiles[0], TRUE);
-        while (faMixedSpeedReadNext(tlf, NULL, NULL, NULL, &faFastBuf, &faFastBufSize))
-            queryCount++;
-        if (numproc > 1)
-            queryCount=queryCount/numproc+1;
-        
-        
-        /* get the offset of each file handler for each process/thread */
-        lineFileRewind(tlf);
-        offsets = (long long int *)malloc(sizeof(long long int) * numproc);
-        offsets[0] = 0;
-        for (i=1; i<numproc; i++)
+        if (oneOff || ooc != NULL || makeOoc != NULL)
         {
-            cnt=queryCount;
-            while (cnt-- && faMixedSpeedReadNext(tlf, NULL, NULL, NULL, &faFastBuf, &faFastBufSize));
-            offsets[i] = tlf->bufOffsetInFile + tlf->lineStart;
+            MPI_Finalize();
+            errAbort("-spacedSeed can't be used with -oneOff, -ooc or -makeOoc");
         }
-        lineFileClose(&tlf);
-        faFreeFastBuf(&faFastBuf, &faFastBufSize);
-        
-        
-        /* Distribute each file handler offset to its corresponding process/thread */
-        tmp = 0;
-        for (pn=nodelist; pn!=NULL; pn=pn->next)
+        if (tileSize > 12)
         {
-            cnt = 0;
-            chooseid = pn->rlist->rank;
-            for (pr=pn->rlist; pr!=NULL; pr=pr->next)
-                cnt++;
-            if (chooseid != 0)
-            {
-                MPI_Send(&queryCount, 1,   MPI_INT, chooseid, 4, MPI_COMM_WORLD);
-                MPI_Send(offsets+tmp, cnt, MPI_LONG_LONG_INT, chooseid, 5, MPI_COMM_WORLD);
-            }
-            else
-            {
-                for (i=0; i<threads; i++)
-                {
-                    lf[i] = lineFileOpen(queryFiles[0], TRUE);
-                    lineFileSeek(lf[i], offsets[i], SEEK_SET);
-                }
-            }
-            tmp += cnt;
+            MPI_Finalize();
+            errAbort("-spacedSeed needs a tileSize of 12 or less");
+        }
+        gfSetSpacedSeed(TRUE);
+    }
+    if (optionExists("sufaSeed"))
+    {
+        int sufaSeed = optionInt("sufaSeed", 0);
+        if (oneOff)
+        {
+            MPI_Finalize();
+            errAbort("-sufaSeed and -oneOff can't be used together");
         }
-        
-        /* free applied memory */
-        pn=nodelist;
-        while(pn != NULL)
+        if (sufaSeed < tileSize)
         {
-            pr = pn->rlist;
-            while(pr != NULL)
-            {
-                prt = pr->next;
-                free(pr);
-                pr = prt;
-            }
-            pnt = pn->next;
-            free(pn);
-            pn = pnt;
+            MPI_Finalize();
+            errAbort("-sufaSeed must be at least tileSize (%d)", tileSize);
         }
-        
-        free(offsets);
+        gfSetSufaSeeds(sufaSeed, optionVal("sufa", NULL));
     }
-    else
+    else if (optionExists("sufa"))
     {
-        offsets = (long long int *)malloc(sizeof(long long int) * threads);
-        
-        MPI_Recv(&queryCount, 1,   MPI_INT, 0, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(offsets, threads, MPI_LONG_LONG_INT, 0, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        
-        for (i=0; i<threads; i++)
+        MPI_Finalize();
+        errAbort("-sufa only makes sense with -sufaSeed");
+    }
+    dedupQueries = optionExists("dedupQueries");
+    if (dedupQueries && !dedupFormat())
+    {
+        warn("-dedupQueries only works with psl, pslx, blast8 and blast9 output, ignoring it");
+        dedupQueries = FALSE;
+    }
+    resultCache = optionVal("resultCache", NULL);
+    if (resultCache != NULL && !dedupFormat())
+    {
+        warn("-resultCache only works with psl, pslx, blast8 and blast9 output, ignoring it");
+        resultCache = NULL;
+    }
+    if (optionExists("minimizerWindow"))
+    {
+        int window = optionInt("minimizerWindow", 0);
+        if (oneOff)
         {
-            lf[i] = lineFileOpen(queryFiles[0], TRUE);
-            lineFileSeek(lf[i], offsets[i], SEEK_SET);
+            MPI_Finalize();
+            errAbort("-minimizerWindow and -oneOff can't be used together");
         }
-        
-        free(offsets);
+        if (window < 1 || window > gfMaxMinimizerWindow)
+        {
+            MPI_Finalize();
+            errAbort("-minimizerWindow must be between 1 and %d", gfMaxMinimizerWindow);
+        }
+        gfSetMinimizerWindow(window);
     }
-    MPI_Finalize();
+    checkpointEvery = optionInt("checkpoint", 0);
+    resume = optionExists("resume");
+    bcastDb = optionExists("bcastDb");
+    streamOut = optionExists("streamOut");
+    if (streamOut && !sameWord(outputFormat, "axt") && !sameWord(outputFormat, "maf"))
+    {
+        warn("-streamOut only works with axt and maf output, ignoring it");
+        streamOut = FALSE;
+    }
+    bestN = optionInt("bestN", 0);
+    if (bestN < 0)
+    {
+        MPI_Finalize();
+        errAbort("-bestN can't be negative");
+    }
+    if (bestN > 0 && optionExists("fine"))
+    {
+        warn("-bestN doesn't work with -fine, ignoring it");
+        bestN = 0;
+    }
+    gfSetBestN(bestN);
+    hitBudget = optionInt("hitBudget", 0);
+    if (hitBudget < 0)
+    {
+        MPI_Finalize();
+        errAbort("-hitBudget can't be negative");
+    }
+    gfSetHitBudget(hitBudget);
+    preScreen = optionExists("preScreen");
+    batchSize = optionInt("batch", 0);
+    if (batchSize < 0)
+    {
+        MPI_Finalize();
+        errAbort("-batch can't be negative");
+    }
+    if (batchSize > 0 && (optionExists("fine") || dedupQueries || resultCache != NULL))
+    {
+        warn("-batch doesn't work with -fine, -dedupQueries or -resultCache, ignoring it");
+        batchSize = 0;
+    }
+    if (checkpointEvery > 0 && tType == gftDnaX)
+    {
+        warn("-checkpoint doesn't work with -t=dnax, ignoring it");
+        checkpointEvery = 0;
+    }
+    if (checkpointEvery > 0 && sameString(argv[3], "stdout"))
+    {
+        MPI_Finalize();
+        errAbort("-checkpoint needs an output file");
+    }
+    if (resume && checkpointEvery <= 0)
+    {
+        MPI_Finalize();
+        errAbort("-resume needs -checkpoint");
+    }
+    bindThreads = optionExists("bindThreads") ||
+                  (numaPolicy != NULL && sameString(numaPolicy, "replicate"));
+    /* set global for fuzzy find functions */
+    setFfIntronMax(optionInt("maxIntron", ffIntronMaxDefault));
+    setFfExtendThroughN(optionExists("extendThroughN"));  
     
 
+    gfClientFileArray(argv[2], &queryFileNames, &queryFileCount);
+    if (queryFileCount > 1 && sameString(argv[3], "stdout"))
+    {
+        MPI_Finalize();
+        errAbort("Output must be a directory when query is a list of files");
+    }
+    queryFiles = makeQueryFiles(queryFileNames, queryFileCount, argv[3]);
 
-    /* Call routine that does the work. */
-    blat(argv[1], queryCount, queryFiles, lf, out);
     
-    
-
-    for (i=0; i<threads; i++)
+    if (checkpointEvery > 0)
+        checkpoints = (struct checkpoint *)calloc(threads, sizeof(struct checkpoint));
+    if (myid == 0)
     {
-        lineFileClose(&(lf[i]));
-        carefulClose(&(out[i]));
+        if (queryFileCount > 1)
+            makeDirsOnPath(argv[3]);
+
+        /* get number of lines that each process/thread should process, and
+         * the offset of each file handler for each process/thread */
+        allOffsets = (long long int *)malloc(sizeof(long long int) * numproc * queryFileCount);
+        for (i=0; i<queryFileCount; i++)
+            queryFiles[i].queryCount = splitQueryFile(queryFiles[i].fileName, allOffsets + i*numproc);
     }
-    free(lf);
-    free(out);
-    
     
-    for (i=0; i<threads; i++)
+    /* Send each leader the number of queries in a part, and the offsets
+     * of the parts its threads are to search, for each query file. */
+    for (i=0; i<queryFileCount; i++)
     {
-        if (myid==0 && i==0) continue;
-        sprintf(buf, "%s.tmp.%d", argv[3], base+i);
-        sprintf(namebuf, "%s.%d", argv[3], base+i);
-        rename(buf, namebuf);
+        struct queryFile *qf = &queryFiles[i];
+        MPI_Bcast(&qf->queryCount, 1, MPI_INT, 0, leaderComm);
+        qf->offsets = (long long int *)malloc(sizeof(long long int) * threads);
+        MPI_Scatterv(myid == 0 ? allOffsets + i*numproc : NULL, partCounts, partStarts,
+                     MPI_LONG_LONG_INT, qf->offsets, threads, MPI_LONG_LONG_INT, 0, leaderComm);
     }
+    free(allOffsets);
+    free(partCounts);
+    free(partStarts);
+    if (bcastDb && makeOoc == NULL)
+        dbSeqList = bcastDatabase(argv[1], leaderComm, !sameString(argv[3], "stdout"));
+    MPI_Comm_free(&leaderComm);
+    MPI_Finalize();
+    
+
+
+    /* Call routine that does the work. */
+    blat(argv[1], dbSeqList, queryFiles, queryFileCount);
+    if (hitBudget > 0 && gfHitBudgetCapCount() > 0)
+        warn("Hits of %ld queries were cut back to -hitBudget=%d on this node",
+             gfHitBudgetCapCount(), hitBudget);
+    if (verboseLevel() >= 2)
+        slabMemReport(stderr);
+    free(checkpoints);
     
     
-    if (myid == 0 && numproc > 1)
+    for (i=0; i<queryFileCount; i++)
     {
-        fres = mustOpen(argv[3], "ab");
-        for (i=1; i<numproc; i++)
+        char *outName = queryFiles[i].outName;
+        if (myid == 0 && numproc > 1 && !mergeParts(outName))
+        {
+            printf("Merge files failed\n");
+            return 1;
+        }
+    
+        /* Whole output is in place, so checkpoints are no longer needed. */
+        if (myid == 0 && checkpointEvery > 0)
         {
-            sprintf(buf, "%s.%d", argv[3], i);
-            
-            while((ftmp = fopen(buf, "rb")) == NULL)
-                sleep(10);
-            
-            while((cnt=fread(buf, 1, 1024*64, ftmp))>0)
+            for (tmp=0; tmp<numproc; tmp++)
             {
-                tmp=fwrite(buf, 1, cnt, fres);
-                if (tmp!=cnt)
-                {
-                    printf("Merge files failed\n");
-                    return 1;
-                }
+                sprintf(buf, "%s.ckpt.%d", outName, tmp);
+                remove(buf);
             }
-            fclose(ftmp);
-            sprintf(buf, "%s.%d", argv[3], i);
-            remove(buf);
         }
-        carefulClose(&fres);
-
+        freeMem(queryFiles[i].outName);
+        free(queryFiles[i].offsets);
     }
+    freeMem(queryFiles);
     
     
     return 0;
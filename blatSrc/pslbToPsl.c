@@ -0,0 +1,53 @@
+/* pslbToPsl - Convert binary psl output of blat to text psl. */
+
+#include "common.h"
+#include "options.h"
+#include "psl.h"
+#include "pslBin.h"
+
+void usage()
+/* Explain usage and exit. */
+{
+errAbort(
+  "pslbToPsl - Convert binary psl (blat -out=pslb) to text psl\n"
+  "usage:\n"
+  "   pslbToPsl in.pslb out.psl\n"
+  "The input may be compressed with bgzip.  A psl header is written\n"
+  "unless blat was run with -noHead.\n"
+  "options:\n"
+  "   -noHead  Do not write psl header\n"
+  );
+}
+
+static struct optionSpec options[] = {
+   {"noHead", OPTION_BOOLEAN},
+   {NULL, 0},
+};
+
+void pslbToPsl(char *inName, char *outName, boolean noHead)
+/* pslbToPsl - Convert binary psl to text psl. */
+{
+struct pslBinFile *pbf = pslBinOpen(inName);
+FILE *f = mustOpen(outName, "w");
+struct psl *psl;
+
+if (pbf->textHead && !noHead)
+    pslWriteHead(f);
+while ((psl = pslBinNext(pbf)) != NULL)
+    {
+    pslTabOut(psl, f);
+    pslFree(&psl);
+    }
+carefulClose(&f);
+pslBinClose(&pbf);
+}
+
+int main(int argc, char *argv[])
+/* Process command line. */
+{
+optionInit(&argc, argv, options);
+if (argc != 3)
+    usage();
+pslbToPsl(argv[1], argv[2], optionExists("noHead"));
+return 0;
+}
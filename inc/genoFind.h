@@ -49,6 +49,7 @@ struct gfSeqSource
     bioSeq *seq;	/* Sequences.  Usually either this or fileName is NULL. */
     bits32 start,end;	/* Position within merged sequence. */
     Bits *maskedBits;	/* If non-null contains repeat-masking info. */
+    int id;		/* Small integer that orders sources as names do, from 1. */
     };
 
 struct gfHit
@@ -116,14 +117,139 @@ struct genoFind
 					  * would be a struct but that would take
 					  * 8 bytes instead of 6, or nearly an
 					  * extra gigabyte of RAM. */
+    UBYTE **packedLists;		 /* Delta encoded list for each N-mer,
+                                          * used instead of lists if index
+					  * is packed.  See gfSetPackedIndex. */
+    size_t packedSize;			 /* Total size of packed lists. */
+    int minimizerWindow;		 /* If non-zero only (w,k) minimizers are
+                                          * indexed, with w this and k tileSize. */
+    int *seedOffsets;			 /* If non-NULL tiles are spaced seeds made
+                                          * from bases at these offsets, and
+					  * tileSize is the span of the seed. */
+    int seedWeight;			 /* Number of seedOffsets. */
+    struct sufa *sufa;			 /* If non-NULL hits come from exact
+                                          * matches in this suffix array rather
+					  * than from the tile lists. */
+    int *sufaSources;			 /* Index in sources of each sufa chrom. */
+    int sufaMinMatch;			 /* Minimum size of exact match used. */
+    bool isReplica;			 /* Copy sharing sources with another. */
     };
 
 void genoFindFree(struct genoFind **pGenoFind);
 /* Free up a genoFind index. */
 
+void gfSetNumaInterleave(boolean interleave);
+/* Set whether index arrays made from now on are spread evenly over
+ * the memory of all NUMA nodes rather than landing on the node of the
+ * thread that builds them. */
+
+void gfSetPackedIndex(boolean pack);
+/* Set whether unsegmented indexes made from now on keep their position
+ * lists delta encoded, which takes less memory at some cost in speed. */
+
+void gfSetSpacedSeed(boolean spaced);
+/* Set whether unsegmented DNA indexes made from now on use the spaced
+ * seed of weight tileSize from spacedSeed.c rather than contiguous tiles. */
+
+#define gfMaxMinimizerWindow 256	/* Largest minimizer window allowed. */
+
+void gfSetMinimizerWindow(int window);
+/* Set window size w for unsegmented DNA indexes made from now on to
+ * hold only (w,k) minimizers rather than every stepSize'th tile.  Zero
+ * for the usual tiling. */
+
+void gfSetHitBudget(int budget);
+/* Set most hits seeding a query (or piece of one) on one strand may find.
+ * Translated searches split this between their frames.  Before any
+ * lookups the tiles with the most hits in the index are dropped until
+ * the rest fit.  Zero for no limit. */
+
+long gfHitBudgetCapCount();
+/* Return number of queries that have gone over the hit budget. */
+
+int *gfHitBudgetCounts(int count);
+/* Return array to fill in with the hits each of count lookups for a query
+ * would make, or NULL if there is no hit budget.  Pass it to
+ * gfHitBudgetListCap before doing the lookups. */
+
+int gfHitBudgetListCap(char *qName, int *counts, int count);
+/* Given the hits each of count lookups for query would make in counts,
+ * from gfHitBudgetCounts, return the most hits a lookup may make and
+ * still be done within the hit budget.  Lookups that would make more are
+ * to be skipped.  Returns BIGNUM if all fit. */
+
+void gfSetSufaSeeds(int minMatch, char *sufaFile);
+/* Set DNA indexes made from now on to seed alignments from exact matches
+ * of at least minMatch bases found in a suffix array rather than from
+ * tiles.  The array is read from sufaFile if that is non-NULL, otherwise
+ * it's built from the sequence being indexed.  A minMatch of zero turns
+ * this off. */
+
+void gfSetHugePages(char *spec);
+/* Set kind of huge pages to back index arrays made from now on, as
+ * described in hugePageAlloc.  NULL for regular memory. */
+
+struct genoFind *gfReplicateIndex(struct genoFind *gf, int node);
+/* Return a copy of index with its arrays on the given NUMA node, so
+ * that threads running there do not have to reach into the memory of
+ * other nodes.  The copy shares sequence sources with the original, and
+ * should be freed with genoFindFree before the original is. */
+
 struct gfSeqSource *gfFindNamedSource(struct genoFind *gf, char *name);
 /* Find target of given name.  Return NULL if none. */
 
+void gfAttachSufa(struct genoFind *gf, struct sufa *sufa, int minMatch);
+/* Have gf seed alignments from exact matches of at least minMatch bases
+ * in sufa.  Each chromosome in sufa must be one of gf's sources.  The
+ * sufa is freed along with gf. */
+
+struct gfHit *gfSufaFindHits(struct genoFind *gf, struct dnaSeq *seq, 
+	Bits *qMaskBits, int qMaskOffset, struct lm *lm, int *retHitCount,
+	struct gfSeqSource *target, int tMin, int tMax);
+/* Find hits associated with one sequence from the exact matches it has
+ * in gf->sufa.  See gfSufa.c. */
+
+struct gfWorkspace
+/* Per-thread scratch space that is reused from query to query, so that
+ * in steady state aligning a query does not go back to the system
+ * allocator.  Get the one for the current thread with gfWorkspaceForThread. */
+    {
+    struct lm *lm;		/* Hits and other per-query odds and ends. */
+    struct hash *bunHash;	/* Bundles of current query keyed by target name. */
+    struct gfHit **buckets;	/* Target position buckets used in clumping. */
+    int bucketAlloc;		/* Allocated size of buckets. */
+    struct gfHit **sortBuf;	/* Scratch arrays for merge sorting hits */
+    struct gfHit **sortTemp;	/* on diagonal. */
+    int sortAlloc;		/* Allocated size of sortBuf and sortTemp. */
+    bits32 *tiles;		/* Tile values of query being looked up. */
+    int tileAlloc;		/* Allocated size of tiles. */
+    bits32 *listBuf;		/* Position list decoded from packed index. */
+    int listAlloc;		/* Allocated size of listBuf. */
+    int *counts;		/* Hits per query lookup for hit budget. */
+    int countAlloc;		/* Allocated size of counts. */
+    int budgetSplit;		/* Searches current query's hit budget is split between. */
+    struct gfClump *freeClumps;	/* Clumps freed and ready for reuse. */
+    int freeClumpCount;		/* Number of clumps on freeClumps. */
+    struct lm *seedLm;		/* Seed hash used while extending alignments. */
+    struct dyString *outLine;	/* Output line being put together. */
+    struct quickHeap *bestHeap;	/* Coverage of best clumps of query so far,
+    				 * least on top.  Used by gfSetBestN. */
+    int *bestCoverage;		/* Values bestHeap points into. */
+    };
+
+#define gfWorkspaceSpareMax (16*1024*1024)
+/* Most bytes of spare local memory blocks a thread keeps for reuse after
+ * a reset.  See lmTrim. */
+
+struct gfWorkspace *gfWorkspaceForThread();
+/* Return workspace of the calling thread, creating it on first use.
+ * It is freed automatically when the thread exits. */
+
+void gfWorkspaceReset(struct gfWorkspace *ws);
+/* Recycle per-query memory in workspace.  Anything allocated out of
+ * ws->lm or stored in ws->bunHash before the reset is gone afterwards.
+ * Spare memory beyond what typical queries need is given back. */
+
 /* ---  Stuff for saving results ---- */
 
 
@@ -198,6 +324,11 @@ struct gfOutput *gfOutputPsl(int goodPpt,
 	boolean saveSeq, boolean noHead);
 /* Set up psl/pslx output */
 
+struct gfOutput *gfOutputPslBin(int goodPpt, 
+	boolean qIsProt, boolean tIsProt, FILE *f, boolean noHead);
+/* Set up binary psl output.  The file header is always written, noHead
+ * just records whether pslbToPsl should write a psl header. */
+
 struct gfOutput *gfOutputAxt(int goodPpt, boolean qIsProt, 
 	boolean tIsProt, FILE *f);
 /* Setup output for axt format. */
@@ -213,6 +344,19 @@ struct gfOutput *gfOutputBlast(int goodPpt,
 	double minIdentity, FILE *f);
 /* Setup output for blast/wublast format. */
 
+FILE *gfOutputSetFile(struct gfOutput *out, FILE *f);
+/* Send psl/pslx, axt, maf and sim4 alignments from now on to f, and
+ * return file they went to before.  The blast formats are only written
+ * to the file passed to gfOutputQuery, so this does nothing and returns
+ * NULL for them.  The others need gfOutputQuery to be passed the same
+ * file as set here. */
+
+boolean gfOutputStream(struct gfOutput *out);
+/* Have axt or maf output written as each alignment is made rather than
+ * at the end of each query.  This saves memory on queries with many
+ * alignments, but changes the order they come out in.  Returns FALSE
+ * for formats that need all alignments of a query before writing. */
+
 void gfOutputQuery(struct gfOutput *out, FILE *f);
 /* Finish writing out results for a query to file. */
 
@@ -262,6 +406,22 @@ void gfIndexTransNibsAndTwoBits(struct genoFind *transGf[2][3],
 
 /* -------- Routines to scan index for homolgous areas ------------ */
 
+void gfFindClumpsBatch(struct genoFind *gf, struct dnaSeq **seqs, Bits **qMaskBits,
+	int seqCount, struct lm *lm, struct gfClump **retClumps);
+/* Find clumps of each of seqs, as gfFindClumpsWithQmask would with a
+ * qMaskOffset of zero, and put those of seqs[i] in retClumps[i].  For
+ * unsegmented DNA indexes, spaced seed ones included, the tiles of the
+ * whole batch are looked up together in order of tile value, so each
+ * position list is read once per batch, and the index is walked in order.
+ * Other indexes (segmented, one-off, suffix array or minimizer) are
+ * searched a sequence at a time.  Hits and tiles are allocated from lm. */
+
+boolean gfQueryMayHit(struct genoFind *gf, struct dnaSeq *seq);
+/* Return FALSE if seq can't have gf->minMatch hits on either strand, so
+ * can't have a clump.  This just adds up the position list sizes of its
+ * tiles, without allocating anything.  Always TRUE for kinds of index
+ * this can't judge. */
+
 struct gfClump *gfFindClumps(struct genoFind *gf, struct dnaSeq *seq, 
 	struct lm *lm, int *retHitCount);
 /* Find clumps associated with one sequence. */
@@ -359,12 +519,29 @@ void gfMakeOoc(char *outName, char *files[], int fileCount,
 	int tileSize, bits32 maxPat, enum gfType tType);
 /* Count occurences of tiles in seqList and make a .ooc file. */
 
+void gfSetBestN(int n);
+/* Have gfLongDnaInMem extend only clumps of hits that cover as much of the
+ * query as the n best clumps found for the query so far, rather than
+ * every clump.  Zero (the default) extends every clump.  The best clumps
+ * are kept over both strands, starting afresh with the forward strand, so
+ * search that one first. */
+
 void gfLongDnaInMem(struct dnaSeq *query, struct genoFind *gf, 
    boolean isRc, int minScore, Bits *qMaskBits, struct gfOutput *out,
    boolean fastMap, boolean band);
 /* Chop up query into pieces, align each, and stitch back
  * together again. */
 
+void gfShortDnaBatchInMem(struct dnaSeq **queries, Bits **qMaskBits,
+	int queryCount, struct genoFind *gf, int minScore, 
+	struct gfOutput *out, FILE *f, boolean fastMap);
+/* Align a batch of queries, each no bigger than MAXSINGLEPIECESIZE, on
+ * both strands, with the same results as gfLongDnaInMem on each strand
+ * of each in turn.  Each query is finished with gfOutputQuery(out, f)
+ * once both its strands are done.  The tiles of the whole batch are
+ * looked up together, and the memory for it all comes from one arena.
+ * qMaskBits may be NULL, or have NULL for queries that aren't masked. */
+
 void gfLongTransTransInMem(struct dnaSeq *query, struct genoFind *gfs[3], 
    struct hash *t3Hash, boolean qIsRc, boolean tIsRc, boolean qIsRna,
    int minScore, struct gfOutput *out);
@@ -246,6 +246,10 @@ struct hash *hashFromSlNameList(void *list);
 struct hash *hashSetFromSlNameList(void *list);
 /* Create a hashSet (hash without values) out of a list of slNames. */
 
+void hashClear(struct hash *hash);
+/* Remove all elements from hash, but keep the table and memory
+ * pool around so that the hash can be refilled cheaply. */
+
 void freeHash(struct hash **pHash);
 /* Free up hash table. */
 #define hashFree(a) freeHash(a)	/* Synonym */
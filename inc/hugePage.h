@@ -0,0 +1,24 @@
+/* hugePage - allocate big arrays backed by huge pages, to cut down on
+ * TLB misses when they are accessed at random. */
+
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+void *hugePageAlloc(size_t size, char *spec);
+/* Allocate size bytes of zeroed memory backed by huge pages as described
+ * by spec, which is one of:
+ *     thp - transparent huge pages, via madvise
+ *     2M or 1G - pages of that size from the kernel's hugetlb pool
+ *     a directory - file in a mounted hugetlbfs
+ * Returns NULL if that kind of memory can't be had. */
+
+boolean hugePageFree(void *pt);
+/* Free memory from hugePageAlloc.  Returns FALSE, doing nothing, if pt
+ * did not come from hugePageAlloc. */
+
+size_t hugePageBacked(void *pt, size_t size, size_t *retPageSize);
+/* Return how many bytes of block are currently backed by huge pages,
+ * and the size of those pages.  Returns 0 if none or if this can't
+ * be determined. */
+
+#endif /* HUGEPAGE_H */
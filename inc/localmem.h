@@ -19,6 +19,14 @@ struct lm *lmInit(int blockSize);
 void lmCleanup(struct lm **pLm);
 /* Clean up a local memory pool. */
 
+void lmReset(struct lm *lm);
+/* Make all memory in pool available again without giving it back to the
+ * system.  Pointers from before the reset are invalid afterwards. */
+
+void lmTrim(struct lm *lm, size_t maxSpare);
+/* Give spare blocks set aside by lmReset back to the system once they
+ * add up to more than maxSpare bytes. */
+
 size_t lmAvailable(struct lm *lm);
 // Returns currently available memory in pool
 
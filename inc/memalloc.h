@@ -44,6 +44,15 @@ size_t carefulTotalAllocated();
 void setMaxAlloc(size_t s);
 /* Set large allocation limit. */
 
+void pushSlabMemHandler();
+/* Push a memory handler that keeps per-thread caches of freed
+ * blocks sorted by size class, which cuts down on lock contention in
+ * the system malloc when many threads are allocating at once.  Best
+ * pushed early, before threads are started. */
+
+void slabMemReport(FILE *f);
+/* Write usage counts of slab memory handler to f. */
+
 void memTrackerStart();
 /* Push memory handler that will track blocks allocated so that
  * they can be automatically released with memTrackerEnd().  */
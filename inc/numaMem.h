@@ -0,0 +1,24 @@
+/* numaMem - place memory and threads on the nodes of a NUMA machine.
+ * These all quietly do nothing on systems without NUMA support, so
+ * callers need not check first. */
+
+#ifndef NUMAMEM_H
+#define NUMAMEM_H
+
+int numaNodeCount();
+/* Return number of NUMA nodes with memory, 1 if not a NUMA system. */
+
+void numaInterleaveMem(void *pt, size_t size);
+/* Ask for the pages of a block to be spread evenly across all nodes.
+ * Only has effect on pages not yet touched. */
+
+void numaPreferMem(void *pt, size_t size, int node);
+/* Ask for the pages of a block to come from the given node where
+ * possible.  Nodes are numbered from 0 to numaNodeCount()-1 whatever
+ * ids the kernel gives them.  Only has effect on pages not yet touched. */
+
+boolean numaBindThread(int node);
+/* Restrict calling thread to the cpus of node, numbered as for
+ * numaPreferMem.  Returns FALSE if that can't be done. */
+
+#endif /* NUMAMEM_H */
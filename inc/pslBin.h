@@ -0,0 +1,89 @@
+/* pslBin - binary version of psl alignment files, that is quick to write
+ * and to read back in.
+ *
+ * A pslBin file starts with three 32 bit numbers: pslBinSig, the version,
+ * and flags (pslBinTextHead if a psl header was wanted).  This is followed
+ * by records, each a type byte followed by 32 bit numbers in the byte
+ * order of the signature:
+ *    pslBinReset - nothing more.  Forget targets and query seen so far.
+ *                  Each stream of records starts with one, so files
+ *                  written in parts can simply be concatenated.
+ *    pslBinQuery - size, name length, name.  Query of alignments that follow.
+ *    pslBinTarget - size, name length, name.  Target numbered one more
+ *                  than the last, from zero.
+ *    pslBinAli - match, misMatch, repMatch, nCount, qNumInsert, qBaseInsert,
+ *                tNumInsert, tBaseInsert, qStart, qEnd, target number,
+ *                tStart, tEnd, blockCount, strand (4 bytes, zero padded),
+ *                then blockSizes, qStarts and tStarts, blockCount each.
+ * Files may be compressed with bgzip. */
+
+#ifndef PSLBIN_H
+#define PSLBIN_H
+
+#ifndef PSL_H
+#include "psl.h"
+#endif
+
+#define pslBinSig 0x42534c50	/* Signature at start of file. */
+#define pslBinVersion 1
+
+enum pslBinFlags
+    {
+    pslBinTextHead = 0x1,	/* Psl header wanted when converted to text. */
+    };
+
+enum pslBinRecordType
+    {
+    pslBinReset = 'H',
+    pslBinQuery = 'Q',
+    pslBinTarget = 'T',
+    pslBinAli = 'A',
+    };
+
+struct pslBinOut
+/* State of a stream of pslBin records being written. */
+    {
+    struct hash *targetIds;	/* Number of each target written, keyed by name. */
+    int targetCount;		/* Number of targets written. */
+    char *lastQuery;		/* Name of last query written. */
+    int lastQuerySize;		/* Size of last query written. */
+    };
+
+struct pslBinOut *pslBinOutNew();
+/* Return state for a new stream of records. */
+
+void pslBinOutFree(struct pslBinOut **pPbo);
+/* Free up stream state. */
+
+void pslBinWriteHead(FILE *f, boolean textHead);
+/* Write pslBin file header. */
+
+void pslBinWrite(struct pslBinOut *pbo, struct psl *psl, FILE *f);
+/* Write psl as records in stream.  Sequence in psl is not written. */
+
+struct pslBinFile
+/* A pslBin file open for reading. */
+    {
+    struct pslBinFile *next;
+    char *fileName;		/* Name of file. */
+    void *bgzf;			/* BGZF handle, which reads plain files too. */
+    boolean isSwapped;		/* Written with other byte order. */
+    boolean textHead;		/* Psl header wanted. */
+    char *qName;		/* Current query. */
+    int qSize;			/* Size of current query. */
+    char **tNames;		/* Targets seen so far. */
+    int *tSizes;		/* Sizes of targets. */
+    int tCount;			/* Number of targets seen so far. */
+    int tAlloc;			/* Allocated size of tNames and tSizes. */
+    };
+
+struct pslBinFile *pslBinOpen(char *fileName);
+/* Open pslBin file and read header. */
+
+void pslBinClose(struct pslBinFile **pPbf);
+/* Close pslBin file and free up associated memory. */
+
+struct psl *pslBinNext(struct pslBinFile *pbf);
+/* Return next psl in file, or NULL at end.  Free with pslFree. */
+
+#endif /* PSLBIN_H */
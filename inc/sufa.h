@@ -52,6 +52,13 @@ void sufaFree(struct sufa **pSufa);
 int sufaOffsetToChromIx(struct sufa *sufa, bits32 tOffset);
 /* Figure out index of chromosome containing tOffset */
 
+struct sufa *sufaFromSeqs(struct dnaSeq *seqList);
+/* Make a suffix array for seqList in memory, laid out just as sufaRead
+ * would leave it.  Only lower case a, c, g and t get indexed.  Anything
+ * else, including upper case bases, which can be used for masking, is
+ * stored as n.  Sorting needs about 16 bytes of temporary memory per
+ * base. */
+
 /** Stuff to define SUFA files **/
 #define SUFA_MAGIC 0x6727B283	/* Magic number at start of SUFA file */
 #define SUFA_MAJOR_VERSION 0	
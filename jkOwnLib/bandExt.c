@@ -12,6 +12,7 @@
 /* Copyright 2003-5 Jim Kent.  All rights reserved. */
 
 #include "common.h"
+#include <pthread.h>
 #include "dnaseq.h"
 #include "axt.h"
 #include "fuzzyFind.h"
@@ -41,6 +42,43 @@ struct score
    int left;
    };
 
+static pthread_key_t lmKey;
+static pthread_once_t lmOnce = PTHREAD_ONCE_INIT;
+#define lmSpareMax (16*1024*1024)	/* Most spare memory kept between calls. */
+
+static void lmFree(void *v)
+/* Free local memory of a thread as it exits. */
+{
+struct lm *lm = v;
+lmCleanup(&lm);
+}
+
+static void lmKeyInit()
+/* Create key for per-thread local memory. */
+{
+if (pthread_key_create(&lmKey, lmFree) != 0)
+    errAbort("Couldn't create thread key for bandExt");
+}
+
+static struct lm *threadLm(size_t size)
+/* Return emptied local memory of the calling thread, making it
+ * with the given block size the first time around. */
+{
+struct lm *lm;
+pthread_once(&lmOnce, lmKeyInit);
+if ((lm = pthread_getspecific(lmKey)) == NULL)
+    {
+    lm = lmInit(size);
+    pthread_setspecific(lmKey, lm);
+    }
+else
+    {
+    lmReset(lm);
+    lmTrim(lm, lmSpareMax);
+    }
+return lm;
+}
+
 boolean bandExt(boolean global, struct axtScoreScheme *ss, int maxInsert,
 	char *aStart, int aSize, char *bStart, int bSize, int dir,
 	int symAlloc, int *retSymCount, char *retSymA, char *retSymB, 
@@ -100,8 +138,9 @@ uglyf("\n");
 
 /* Make up a local mem structure big enough for everything. 
  * This is just a minor, perhaps misguided speed tweak to
- * avoid multiple mallocs. */
-lm = lmInit(
+ * avoid multiple mallocs.  The structure is kept from call
+ * to call in each thread. */
+lm = threadLm(
     sizeof(bOffsets[0])*aSize +
     sizeof(parents[0])*bandSize +
     bandSize*(sizeof(parents[0][0])*aSize) +
@@ -417,8 +456,7 @@ if (dir < 0)
     reverseBytes(bStart, bSize);
     }
 
-/* Clean up, set return values and go home */
-lmCleanup(&lm);
+/* Set return values and go home */
 if (retStartA != NULL) *retStartA = aBestPos;
 if (retStartB != NULL) *retStartB = bBestPos;
 *retSymCount = symCount;
@@ -155,12 +155,13 @@ static struct ffAli *ffFindExtendNmers(char *nStart, char *nEnd, char *hStart, c
 	int seedSize)
 /* Find perfectly matching n-mers and extend them. */
 {
-struct lm *lm = lmInit(32*1024);
+struct lm *lm = gfWorkspaceForThread()->seedLm;
 struct seqHashEl **hashTable, *hashEl, **hashSlot;
 struct ffAli *ffList = NULL, *ff;
 char *n = nStart, *h = hStart, *ne = nEnd - seedSize, *he = hEnd - seedSize;
 
 /* Hash the needle. */
+lmReset(lm);
 lmAllocArray(lm, hashTable, 4*1024);
 while (n <= ne)
     {
@@ -198,7 +199,6 @@ while (h <= he)
     }
 ffList = ffMakeRightLinks(ffList);
 ffList = ffMergeClose(ffList, nStart, hStart);
-lmCleanup(&lm);
 return ffList;
 }
 
@@ -257,7 +257,8 @@ for (hit = clump->hitList; ; hit = hit->next)
 		AllocVar(range);
 		range->qStart = qs - qSeq->dna;
 		range->qEnd = qe - qSeq->dna;
-		range->tName = cloneString(tSeq->name);
+		range->tName = tSeq->name;
+		range->tId = target->id;
 		range->tSeq = tSeq;
 		range->tStart = ts - tSeq->dna;
 		range->tEnd = te - tSeq->dna;
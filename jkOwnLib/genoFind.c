@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include <signal.h>
+#include <pthread.h>
 #include "obscure.h"
 #include "dnautil.h"
 #include "dnaseq.h"
@@ -18,6 +19,11 @@
 #include "genoFind.h"
 #include "trans3.h"
 #include "binRange.h"
+#include "numaMem.h"
+#include "hugePage.h"
+#include "spacedSeed.h"
+#include "sufa.h"
+#include "quickHeap.h"
 
 
 char *gfSignature()
@@ -65,6 +71,165 @@ while (totalRead < size)
 return totalRead;
 }
 
+static boolean numaInterleave = FALSE;	/* Spread index over NUMA nodes? */
+static char *hugePageSpec = NULL;	/* Kind of huge pages for index, NULL for none. */
+static boolean packIndex = FALSE;	/* Delta encode position lists? */
+static int minimizerWindow = 0;		/* Index only minimizers of this many tiles. */
+static boolean spacedSeed = FALSE;	/* Use spaced seeds rather than contiguous tiles? */
+static int sufaMinMatch = 0;		/* Seed from suffix array matches this big. */
+static char *sufaFile = NULL;		/* Prebuilt suffix array, NULL to make one. */
+static int hitBudget = 0;		/* Most hits a query may have, 0 for no limit. */
+static struct hash *hitBudgetCapped = NULL;	/* Names of queries that went over hitBudget. */
+static pthread_mutex_t hitBudgetMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void gfSetNumaInterleave(boolean interleave)
+/* Set whether index arrays made from now on are spread evenly over
+ * the memory of all NUMA nodes rather than landing on the node of the
+ * thread that builds them. */
+{
+numaInterleave = interleave;
+}
+
+void gfSetPackedIndex(boolean pack)
+/* Set whether unsegmented indexes made from now on keep their position
+ * lists delta encoded, which takes less memory at some cost in speed. */
+{
+packIndex = pack;
+}
+
+void gfSetSpacedSeed(boolean spaced)
+/* Set whether unsegmented DNA indexes made from now on use the spaced
+ * seed of weight tileSize from spacedSeed.c rather than contiguous tiles. */
+{
+spacedSeed = spaced;
+}
+
+void gfSetSufaSeeds(int minMatch, char *fileName)
+/* Set DNA indexes made from now on to seed alignments from exact matches
+ * of at least minMatch bases found in a suffix array rather than from
+ * tiles.  The array is read from fileName if that is non-NULL, otherwise
+ * it's built from the sequence being indexed.  A minMatch of zero turns
+ * this off. */
+{
+sufaMinMatch = minMatch;
+sufaFile = fileName;
+}
+
+void gfSetMinimizerWindow(int window)
+/* Set window size w for unsegmented DNA indexes made from now on to
+ * hold only (w,k) minimizers rather than every stepSize'th tile.  Zero
+ * for the usual tiling. */
+{
+if (window < 0 || window > gfMaxMinimizerWindow)
+    errAbort("Minimizer window must be between 0 and %d", gfMaxMinimizerWindow);
+minimizerWindow = window;
+}
+
+void gfSetHitBudget(int budget)
+/* Set most hits seeding a query (or piece of one) on one strand may find.
+ * Translated searches split this between their frames.  Before any
+ * lookups the tiles with the most hits in the index are dropped until
+ * the rest fit.  Zero for no limit. */
+{
+if (budget < 0)
+    errAbort("Hit budget can't be negative");
+hitBudget = budget;
+}
+
+long gfHitBudgetCapCount()
+/* Return number of queries that have gone over the hit budget. */
+{
+long count;
+pthread_mutex_lock(&hitBudgetMutex);
+count = (hitBudgetCapped == NULL ? 0 : hitBudgetCapped->elCount);
+pthread_mutex_unlock(&hitBudgetMutex);
+return count;
+}
+
+void gfSetHugePages(char *spec)
+/* Set kind of huge pages to back index arrays made from now on, as
+ * described in hugePageAlloc.  NULL for regular memory. */
+{
+hugePageSpec = spec;
+}
+
+static void *gfIndexAlloc(size_t size, boolean zero)
+/* Allocate one of the big index arrays, optionally zeroed.  Memory
+ * placement policy is set before any page is touched. */
+{
+void *pt = NULL;
+if (hugePageSpec != NULL)
+    {
+    static boolean warned = FALSE;
+    if ((pt = hugePageAlloc(size, hugePageSpec)) != NULL)
+        zero = FALSE;	/* Fresh mappings are already zero. */
+    else if (!warned)
+        {
+	warn("Couldn't get %s huge pages for index, using regular memory", hugePageSpec);
+	warned = TRUE;
+	}
+    }
+if (pt == NULL)
+    pt = needHugeMem(size);
+if (numaInterleave)
+    numaInterleaveMem(pt, size);
+if (zero)
+    memset(pt, 0, size);
+return pt;
+}
+
+static void gfIndexFree(void *pt)
+/* Free array from gfIndexAlloc. */
+{
+if (!hugePageFree(pt))
+    freeMem(pt);
+}
+
+static void reportPages(char *what, void *pt, size_t size)
+/* Report how much of an index array got huge pages. */
+{
+size_t pageSize = 0;
+size_t backed = (pt == NULL ? 0 : hugePageBacked(pt, size, &pageSize));
+if (pageSize > 0)
+    verbose(2, "%s: %llu of %llu bytes on %llu kB pages\n", what,
+	(unsigned long long)backed, (unsigned long long)size,
+	(unsigned long long)pageSize/1024);
+else
+    verbose(2, "%s: %llu bytes on regular pages\n", what, (unsigned long long)size);
+}
+
+static size_t gfListCount(struct genoFind *gf)
+/* Return total number of positions in lists of index. */
+{
+size_t count = 0;
+int i;
+for (i=0; i<gf->tileSpaceSize; ++i)
+    count += gf->listSizes[i];
+return count;
+}
+
+static void gfReportPages(struct genoFind *gf)
+/* Report page sizes backing index arrays. */
+{
+size_t tileSpaceSize = gf->tileSpaceSize;
+reportPages("index listSizes", gf->listSizes, tileSpaceSize * sizeof(gf->listSizes[0]));
+if (gf->segSize > 0)
+    {
+    reportPages("index endLists", gf->endLists, tileSpaceSize * sizeof(gf->endLists[0]));
+    reportPages("index positions", gf->allocated, 3 * gfListCount(gf) * sizeof(bits16));
+    }
+else if (gf->packedLists != NULL)
+    {
+    reportPages("index packed lists", gf->packedLists, tileSpaceSize * sizeof(gf->packedLists[0]));
+    reportPages("index packed positions", gf->allocated, gf->packedSize);
+    }
+else
+    {
+    reportPages("index lists", gf->lists, tileSpaceSize * sizeof(gf->lists[0]));
+    reportPages("index positions", gf->allocated, gfListCount(gf) * sizeof(bits32));
+    }
+}
+
 void genoFindFree(struct genoFind **pGenoFind)
 /* Free up a genoFind index. */
 {
@@ -73,15 +238,23 @@ int i;
 struct gfSeqSource *sources;
 if (gf != NULL)
     {
-    freeMem(gf->lists);
-    freeMem(gf->listSizes);
-    freeMem(gf->allocated);
-    if ((sources = gf->sources) != NULL)
+    gfIndexFree(gf->lists);
+    gfIndexFree(gf->packedLists);
+    gfIndexFree(gf->endLists);
+    gfIndexFree(gf->listSizes);
+    gfIndexFree(gf->allocated);
+    if ((sources = gf->sources) != NULL && !gf->isReplica)
 	{
 	for (i=0; i<gf->sourceCount; ++i)
 	    bitFree(&sources[i].maskedBits);
 	freeMem(sources);
 	}
+    if (!gf->isReplica)
+	{
+	freeMem(gf->seedOffsets);
+	sufaFree(&gf->sufa);
+	freeMem(gf->sufaSources);
+	}
     freez(pGenoFind);
     }
 }
@@ -145,19 +318,29 @@ else
 gf->segSize = segSize;
 gf->tileSize = tileSize;
 gf->stepSize = stepSize;
+if (spacedSeed && !isPep && !allowOneMismatch && segSize == 0)
+    {
+    /* Tiles are spread over the span of the seed, so as far as placing
+     * hits goes that is the size of a tile. */
+    if (oocFile != NULL)
+	errAbort("Can't use ooc files with spaced seeds");
+    gf->seedWeight = tileSize;
+    gf->seedOffsets = spacedSeedOffsets(tileSize);
+    gf->tileSize = spacedSeedSpan(tileSize);
+    }
 gf->isPep = isPep;
 gf->allowOneMismatch = allowOneMismatch;
 if (segSize > 0)
     {
-    gf->endLists = needHugeZeroedMem(tileSpaceSize * sizeof(gf->endLists[0]));
+    gf->endLists = gfIndexAlloc(tileSpaceSize * sizeof(gf->endLists[0]), TRUE);
     maxPat = BIGNUM;	/* Don't filter out overused on the big ones.  It is
                          * unnecessary and would be quite complex. */
     }
 else
     {
-    gf->lists = needHugeZeroedMem(tileSpaceSize * sizeof(gf->lists[0]));
+    gf->lists = gfIndexAlloc(tileSpaceSize * sizeof(gf->lists[0]), TRUE);
     }
-gf->listSizes = needHugeZeroedMem(tileSpaceSize * sizeof(gf->listSizes[0]));
+gf->listSizes = gfIndexAlloc(tileSpaceSize * sizeof(gf->listSizes[0]), TRUE);
 gf->minMatch = minMatch;
 gf->maxGap = maxGap;
 gf->maxPat = maxPat;
@@ -213,6 +396,29 @@ for (i=0; i<n; ++i)
 return tile;
 }
 
+static int gfSpacedTile(DNA *dna, int *offsets, int weight)
+/* Make a packed DNA tile out of the bases at the given offsets. */
+{
+int tile = 0;
+int i, c;
+for (i=0; i<weight; ++i)
+    {
+    tile <<= 2;
+    if ((c = ntLookup[(int)dna[offsets[i]]]) < 0)
+        return -1;
+    tile += c;
+    }
+return tile;
+}
+
+static int gfSeedTile(struct genoFind *gf, DNA *dna)
+/* Make tile starting at dna for an unsegmented DNA index. */
+{
+if (gf->seedOffsets != NULL)
+    return gfSpacedTile(dna, gf->seedOffsets, gf->seedWeight);
+return gfDnaTile(dna, gf->tileSize);
+}
+
 int gfPepTile(AA *pep, int n)
 /* Make up packed representation of translated protein. */
 {
@@ -229,6 +435,110 @@ while (--n >= 0)
 return tile;
 }
 
+struct minimizerScan
+/* Keeps track of (w,k) minimizers while walking along a sequence. The
+ * minimizer of a window of w consecutive tiles is the one with the
+ * lowest hash value, leftmost on ties. */
+    {
+    struct genoFind *gf;	/* Index tiles are made for. */
+    DNA *dna;			/* Sequence. */
+    int window;			/* Tiles per window (w). */
+    int lastTile;		/* Start of last tile in sequence. */
+    int nextPos;		/* Start of next tile to look at. */
+    int lastOut;		/* Position of last minimizer returned. */
+    int first, count;		/* Part of ring in use. */
+    int pos[gfMaxMinimizerWindow];	/* Candidate positions, hashes ascending. */
+    int tile[gfMaxMinimizerWindow];	/* Candidate tiles. */
+    bits32 hash[gfMaxMinimizerWindow];	/* Candidate hashes. */
+    };
+
+static bits32 minimizerHash(int tile)
+/* Scramble tile so poly-A and the like don't always win. */
+{
+bits32 x = tile;
+x *= 0x9E3779B1;
+x ^= x >> 16;
+return x;
+}
+
+static void minimizerScanInit(struct minimizerScan *scan, struct genoFind *gf,
+	DNA *dna, int size)
+/* Get ready to find minimizers of dna. */
+{
+scan->gf = gf;
+scan->dna = dna;
+scan->window = gf->minimizerWindow;
+scan->lastTile = size - gf->tileSize;
+scan->nextPos = 0;
+scan->lastOut = -1;
+scan->first = scan->count = 0;
+}
+
+static boolean minimizerScanNext(struct minimizerScan *scan, int *retTile, int *retPos)
+/* Get next minimizer in sequence.  Returns FALSE at end.  Tiles with
+ * N's in them are never minimizers. */
+{
+int window = scan->window;
+while (scan->nextPos <= scan->lastTile)
+    {
+    int i = scan->nextPos++;
+    int tile = gfSeedTile(scan->gf, scan->dna + i);
+    /* Drop candidates that have slid out of the window first, so that
+     * at most window-1 are left and the new one fits in the ring. */
+    while (scan->count > 0 && scan->pos[scan->first] <= i - window)
+	{
+	scan->first = (scan->first + 1) % window;
+	scan->count -= 1;
+	}
+    if (tile >= 0)
+	{
+	bits32 hash = minimizerHash(tile);
+	int ix;
+	while (scan->count > 0)
+	    {
+	    ix = (scan->first + scan->count - 1) % window;
+	    if (scan->hash[ix] <= hash)
+		break;
+	    scan->count -= 1;
+	    }
+	ix = (scan->first + scan->count) % window;
+	scan->pos[ix] = i;
+	scan->tile[ix] = tile;
+	scan->hash[ix] = hash;
+	scan->count += 1;
+	}
+    if (scan->count > 0 && (i >= window-1 || i == scan->lastTile))
+	{
+	int pos = scan->pos[scan->first];
+	if (pos != scan->lastOut)
+	    {
+	    scan->lastOut = pos;
+	    *retTile = scan->tile[scan->first];
+	    *retPos = pos;
+	    return TRUE;
+	    }
+	}
+    }
+return FALSE;
+}
+
+static void gfCountMinimizerSeq(struct genoFind *gf, bioSeq *seq)
+/* Count minimizers in seq. */
+{
+struct minimizerScan scan;
+bits32 *listSizes = gf->listSizes;
+int maxPat = gf->maxPat;
+int tile, pos;
+
+initNtLookup();
+minimizerScanInit(&scan, gf, seq->dna, seq->size);
+while (minimizerScanNext(&scan, &tile, &pos))
+    {
+    if (listSizes[tile] < maxPat)
+	listSizes[tile] += 1;
+    }
+}
+
 static void gfCountSeq(struct genoFind *gf, bioSeq *seq)
 /* Add all N-mers in seq. */
 {
@@ -242,10 +552,19 @@ bits32 *listSizes = gf->listSizes;
 int i, lastTile = seq->size - tileSize;
 int (*makeTile)(char *poly, int n) = (gf->isPep ? gfPepTile : gfDnaTile);
 
+if (gf->minimizerWindow > 0)
+    {
+    gfCountMinimizerSeq(gf, seq);
+    return;
+    }
 initNtLookup();
 for (i=0; i<=lastTile; i += stepSize)
     {
-    if ((tile = makeTile(poly, tileHeadSize)) >= 0)
+    if (gf->seedOffsets != NULL)
+	tile = gfSpacedTile(poly, gf->seedOffsets, gf->seedWeight);
+    else
+	tile = makeTile(poly, tileHeadSize);
+    if (tile >= 0)
 	{
         if (listSizes[tile] < maxPat)
 	    {
@@ -353,7 +672,7 @@ for (i=0; i<tileSpaceSize; ++i)
         }
     }
 if (count > 0)
-    gf->allocated = allocated = needHugeMem(count*sizeof(allocated[0]));
+    gf->allocated = allocated = gfIndexAlloc(count*sizeof(allocated[0]), FALSE);
 for (i=0; i<tileSpaceSize; ++i)
     {
     if ((size = listSizes[i]) < maxPat)
@@ -380,7 +699,7 @@ int tileSpaceSize = gf->tileSpaceSize;
 for (i=0; i<tileSpaceSize; ++i)
     count += listSizes[i];
 if (count > 0)
-    gf->allocated = allocated = needHugeMem(3*count*sizeof(allocated[0]));
+    gf->allocated = allocated = gfIndexAlloc(3*count*sizeof(allocated[0]), FALSE);
 for (i=0; i<tileSpaceSize; ++i)
     {
     size = listSizes[i];
@@ -405,9 +724,24 @@ bits32 *listSizes = gf->listSizes;
 bits32 **lists = gf->lists;
 
 initNtLookup();
+if (gf->minimizerWindow > 0)
+    {
+    struct minimizerScan scan;
+    int pos;
+    minimizerScanInit(&scan, gf, seq->dna, seq->size);
+    while (minimizerScanNext(&scan, &tile, &pos))
+	{
+	if (listSizes[tile] < maxPat)
+	    lists[tile][listSizes[tile]++] = offset + pos;
+	}
+    return;
+    }
 for (i=0; i<=lastTile; i += stepSize)
     {
-    tile = makeTile(poly, tileSize);
+    if (gf->seedOffsets != NULL)
+	tile = gfSpacedTile(poly, gf->seedOffsets, gf->seedWeight);
+    else
+	tile = makeTile(poly, tileSize);
     if (tile >= 0)
         {
 	if (listSizes[tile] < maxPat)
@@ -420,6 +754,155 @@ for (i=0; i<=lastTile; i += stepSize)
     }
 }
 
+static void gfPackTile(struct genoFind *gf, int tile, bits32 offset,
+	bits32 *lastPos, bits32 *packSizes)
+/* Add one position to packed index.  If packSizes is non-NULL just add up
+ * the bytes the list will need there, otherwise write it out, advancing
+ * gf->packedLists[tile].  Each list is a series of differences from the
+ * previous position (the first from zero), seven bits to a byte, with
+ * the high bit set on all but the last byte of a number. */
+{
+bits32 delta = offset - lastPos[tile];
+lastPos[tile] = offset;
+if (packSizes != NULL)
+    {
+    int size = 1;
+    while (delta >= 0x80)
+	{
+	delta >>= 7;
+	++size;
+	}
+    packSizes[tile] += size;
+    }
+else
+    {
+    UBYTE *pt = gf->packedLists[tile];
+    while (delta >= 0x80)
+	{
+	*pt++ = (delta & 0x7f) | 0x80;
+	delta >>= 7;
+	}
+    *pt++ = delta;
+    gf->packedLists[tile] = pt;
+    }
+}
+
+static void gfPackSeq(struct genoFind *gf, bioSeq *seq, bits32 offset,
+	bits32 *lastPos, bits32 *packSizes)
+/* Add all N-mers in seq to packed index, or just size lists if packSizes
+ * is non-NULL. */
+{
+char *poly = seq->dna;
+int tileSize = gf->tileSize;
+int stepSize = gf->stepSize;
+int i, lastTile = seq->size - tileSize;
+int (*makeTile)(char *poly, int n) = (gf->isPep ? gfPepTile : gfDnaTile);
+int maxPat = gf->maxPat;
+int tile;
+bits32 *listSizes = gf->listSizes;
+
+initNtLookup();
+if (gf->minimizerWindow > 0)
+    {
+    struct minimizerScan scan;
+    int pos;
+    minimizerScanInit(&scan, gf, seq->dna, seq->size);
+    while (minimizerScanNext(&scan, &tile, &pos))
+	{
+	if (listSizes[tile] < maxPat)
+	    gfPackTile(gf, tile, offset + pos, lastPos, packSizes);
+	}
+    return;
+    }
+for (i=0; i<=lastTile; i += stepSize)
+    {
+    if (gf->seedOffsets != NULL)
+	tile = gfSpacedTile(poly, gf->seedOffsets, gf->seedWeight);
+    else
+	tile = makeTile(poly, tileSize);
+    if (tile >= 0 && listSizes[tile] < maxPat)
+	gfPackTile(gf, tile, offset, lastPos, packSizes);
+    offset += stepSize;
+    poly += stepSize;
+    }
+}
+
+static void gfPackLists(struct genoFind *gf, bioSeq *seqList)
+/* Build delta encoded lists for all seqs in list.  Done after gfCountSeq.
+ * Sizes the lists in one pass over the sequence and fills them in a second,
+ * so the unencoded lists never need to be in memory at all. */
+{
+int tileSpaceSize = gf->tileSpaceSize;
+bits32 *lastPos = needHugeZeroedMem(tileSpaceSize * sizeof(lastPos[0]));
+bits32 *packSizes = needHugeZeroedMem(tileSpaceSize * sizeof(packSizes[0]));
+bits32 offset;
+size_t total = 0;
+UBYTE *packed;
+bioSeq *seq;
+int i;
+
+gfIndexFree(gf->lists);
+gf->lists = NULL;
+for (seq = seqList, offset = 0; seq != NULL; offset += seq->size, seq = seq->next)
+    gfPackSeq(gf, seq, offset, lastPos, packSizes);
+for (i=0; i<tileSpaceSize; ++i)
+    total += packSizes[i];
+gf->packedSize = total;
+gf->packedLists = gfIndexAlloc(tileSpaceSize * sizeof(gf->packedLists[0]), TRUE);
+if (total > 0)
+    gf->allocated = packed = gfIndexAlloc(total, FALSE);
+else
+    packed = NULL;
+for (i=0; i<tileSpaceSize; ++i)
+    {
+    gf->packedLists[i] = packed;
+    packed += packSizes[i];
+    }
+
+memset(lastPos, 0, tileSpaceSize * sizeof(lastPos[0]));
+for (seq = seqList, offset = 0; seq != NULL; offset += seq->size, seq = seq->next)
+    gfPackSeq(gf, seq, offset, lastPos, NULL);
+for (i=0; i<tileSpaceSize; ++i)
+    gf->packedLists[i] -= packSizes[i];
+freeMem(lastPos);
+freeMem(packSizes);
+}
+
+static bits32 *gfTileList(struct genoFind *gf, int tile, bits32 **pBuf, int *pBufAlloc)
+/* Return position list for tile.  If the index is packed the list is
+ * decoded into *pBuf, which is grown as need be. */
+{
+UBYTE *pt;
+bits32 *buf, pos = 0;
+int i, listSize;
+
+if (gf->packedLists == NULL)
+    return gf->lists[tile];
+listSize = gf->listSizes[tile];
+if (listSize > *pBufAlloc)
+    {
+    freeMem(*pBuf);
+    *pBufAlloc = max(listSize, 2 * *pBufAlloc);
+    *pBuf = needLargeMem(*pBufAlloc * sizeof(bits32));
+    }
+buf = *pBuf;
+pt = gf->packedLists[tile];
+for (i=0; i<listSize; ++i)
+    {
+    bits32 delta = 0;
+    int shift = 0;
+    UBYTE b;
+    do  {
+	b = *pt++;
+	delta |= (bits32)(b & 0x7f) << shift;
+	shift += 7;
+	} while (b & 0x80);
+    pos += delta;
+    buf[i] = pos;
+    }
+return buf;
+}
+
 static void gfAddLargeSeq(struct genoFind *gf, bioSeq *seq, bits32 offset)
 /* Add all N-mers to segmented index.  Done after gfCountSeq. */
 {
@@ -521,6 +1004,44 @@ for (i=0; i<tileSpaceSize; ++i)
     }
 }
 
+static char *sourceName(struct gfSeqSource *ss)
+/* Return name of sequence source, the same way clumpTargetName does. */
+{
+char *name = (ss->seq != NULL ? ss->seq->name : ss->fileName);
+return (name != NULL ? name : "");
+}
+
+static int sourceNameCmp(const void *va, const void *vb)
+/* Compare sequence sources by name. */
+{
+struct gfSeqSource *a = *((struct gfSeqSource **)va);
+struct gfSeqSource *b = *((struct gfSeqSource **)vb);
+return strcmp(sourceName(a), sourceName(b));
+}
+
+static void numberSources(struct genoFind *gf)
+/* Give each source an id that is one more than the rank of its name,
+ * so that comparing ids gives the same order as comparing names. */
+{
+int count = gf->sourceCount;
+struct gfSeqSource **order;
+int i, id = 0;
+
+if (count == 0)
+    return;
+AllocArray(order, count);
+for (i=0; i<count; ++i)
+    order[i] = &gf->sources[i];
+qsort(order, count, sizeof(order[0]), sourceNameCmp);
+for (i=0; i<count; ++i)
+    {
+    if (i == 0 || sourceNameCmp(&order[i-1], &order[i]) != 0)
+	++id;
+    order[i]->id = id;
+    }
+freeMem(order);
+}
+
 struct genoFind *gfIndexNibsAndTwoBits(int fileCount, char *fileNames[],
 	int minMatch, int maxGap, int tileSize, int maxPat, char *oocFile,
 	boolean allowOneMismatch, int stepSize)
@@ -545,7 +1066,7 @@ int totalSeq = 0;
 if (allowOneMismatch)
     errAbort("Don't currently support allowOneMismatch in gfIndexNibsAndTwoBits");
 if (stepSize == 0)
-    stepSize = gf->tileSize;
+    stepSize = gf->stepSize;
 for (i=0; i<fileCount; ++i)
     {
     fileName = fileNames[i];
@@ -607,6 +1128,7 @@ for (i=0; i<fileCount; ++i)
     }
 gf->totalSeqSize = offset;
 gfZeroOverused(gf);
+numberSources(gf);
 printf("Done adding\n");
 return gf;
 }
@@ -840,6 +1362,7 @@ for (isRc=0; isRc <= 1; ++isRc)
 	gf = transGf[isRc][frame];
 	gf->totalSeqSize = offset[isRc][frame];
 	gfZeroOverused(gf);
+	numberSources(gf);
 	}
     }
 }
@@ -859,14 +1382,20 @@ if (isPep)
     maskSimplePepRepeat(gf);
 for (seq = seqList; seq != NULL; seq = seq->next)
     gfCountSeq(gf, seq);
-gfAllocLists(gf);
-gfZeroNonOverused(gf);
+if (packIndex)
+    gfPackLists(gf, seqList);
+else
+    {
+    gfAllocLists(gf);
+    gfZeroNonOverused(gf);
+    }
 if (seqCount > 0)
     AllocArray(gf->sources, seqCount);
 gf->sourceCount = seqCount;
 for (i=0, seq = seqList; i<seqCount; ++i, seq = seq->next)
     {
-    gfAddSeq(gf, seq, offset);
+    if (!packIndex)
+	gfAddSeq(gf, seq, offset);
     ss = gf->sources+i;
     ss->seq = seq;
     ss->start = offset;
@@ -940,6 +1469,8 @@ struct genoFind *gf = gfNewEmpty(minMatch, maxGap, tileSize, stepSize, maxPat,
 				oocFile, isPep, allowOneMismatch);
 if (stepSize == 0)
     stepSize = tileSize;
+if (gf->segSize == 0 && !isPep && !allowOneMismatch)
+    gf->minimizerWindow = minimizerWindow;
 if (gf->segSize > 0)
     {
     gfLargeIndexSeq(gf, seqList, minMatch, maxGap, tileSize, maxPat, oocFile, isPep, maskUpper);
@@ -948,9 +1479,75 @@ else
     {
     gfSmallIndexSeq(gf, seqList, minMatch, maxGap, tileSize, maxPat, oocFile, isPep, maskUpper);
     }
+numberSources(gf);
+if (sufaMinMatch > 0 && !isPep)
+    {
+    struct sufa *sufa = (sufaFile != NULL ? sufaRead(sufaFile, TRUE) : sufaFromSeqs(seqList));
+    gfAttachSufa(gf, sufa, sufaMinMatch);
+    }
+if (hugePageSpec != NULL)
+    gfReportPages(gf);
 return gf;
 }
 
+static void *copyToNode(void *source, size_t size, int node)
+/* Return copy of memory block placed on given NUMA node. */
+{
+void *pt = gfIndexAlloc(size, FALSE);
+numaPreferMem(pt, size, node);
+memcpy(pt, source, size);
+return pt;
+}
+
+struct genoFind *gfReplicateIndex(struct genoFind *gf, int node)
+/* Return a copy of index with its arrays on the given NUMA node, so
+ * that threads running there do not have to reach into the memory of
+ * other nodes.  The copy shares sequence sources with the original, and
+ * should be freed with genoFindFree before the original is. */
+{
+struct genoFind *copy = CloneVar(gf);
+int tileSpaceSize = gf->tileSpaceSize;
+size_t listCount = gfListCount(gf), allocSize;
+int i;
+
+copy->isReplica = TRUE;
+copy->listSizes = copyToNode(gf->listSizes, tileSpaceSize * sizeof(gf->listSizes[0]), node);
+if (gf->segSize > 0)
+    {
+    bits16 *base = gf->allocated;
+    allocSize = 3 * listCount * sizeof(bits16);
+    copy->allocated = (allocSize > 0 ? copyToNode(gf->allocated, allocSize, node) : NULL);
+    copy->endLists = gfIndexAlloc(tileSpaceSize * sizeof(copy->endLists[0]), FALSE);
+    numaPreferMem(copy->endLists, tileSpaceSize * sizeof(copy->endLists[0]), node);
+    for (i=0; i<tileSpaceSize; ++i)
+	copy->endLists[i] = (gf->endLists[i] == NULL ? NULL :
+		(bits16 *)copy->allocated + (gf->endLists[i] - base));
+    }
+else if (gf->packedLists != NULL)
+    {
+    UBYTE *base = gf->allocated;
+    allocSize = gf->packedSize;
+    copy->allocated = (allocSize > 0 ? copyToNode(gf->allocated, allocSize, node) : NULL);
+    copy->packedLists = gfIndexAlloc(tileSpaceSize * sizeof(copy->packedLists[0]), FALSE);
+    numaPreferMem(copy->packedLists, tileSpaceSize * sizeof(copy->packedLists[0]), node);
+    for (i=0; i<tileSpaceSize; ++i)
+	copy->packedLists[i] = (gf->packedLists[i] == NULL ? NULL :
+		(UBYTE *)copy->allocated + (gf->packedLists[i] - base));
+    }
+else
+    {
+    bits32 *base = gf->allocated;
+    allocSize = listCount * sizeof(bits32);
+    copy->allocated = (allocSize > 0 ? copyToNode(gf->allocated, allocSize, node) : NULL);
+    copy->lists = gfIndexAlloc(tileSpaceSize * sizeof(copy->lists[0]), FALSE);
+    numaPreferMem(copy->lists, tileSpaceSize * sizeof(copy->lists[0]), node);
+    for (i=0; i<tileSpaceSize; ++i)
+	copy->lists[i] = (gf->lists[i] == NULL ? NULL :
+		(bits32 *)copy->allocated + (gf->lists[i] - base));
+    }
+return copy;
+}
+
 static int bCmpSeqSource(const void *vTarget, const void *vRange)
 /* Compare function for binary search of gfSeqSource. */
 {
@@ -973,13 +1570,104 @@ if (ss == NULL)
 return ss;
 }
 
+static pthread_key_t workspaceKey;
+static pthread_once_t workspaceOnce = PTHREAD_ONCE_INIT;
+
+/* Most clumps kept on a thread's free list, so that a query with a lot
+ * of them doesn't leave them pinned for the rest of the run. */
+#define workspaceFreeClumpMax (64*1024)
+
+static void workspaceFree(void *v)
+/* Free up workspace.  Called by pthreads as thread exits. */
+{
+struct gfWorkspace *ws = v;
+lmCleanup(&ws->lm);
+lmCleanup(&ws->seedLm);
+freeHash(&ws->bunHash);
+freeMem(ws->buckets);
+freeMem(ws->sortBuf);
+freeMem(ws->sortTemp);
+freeMem(ws->tiles);
+freeMem(ws->listBuf);
+freeMem(ws->counts);
+slFreeList(&ws->freeClumps);
+freeDyString(&ws->outLine);
+if (ws->bestHeap != NULL)
+    freeQuickHeap(&ws->bestHeap);
+freeMem(ws->bestCoverage);
+freeMem(ws);
+}
+
+static void workspaceKeyInit()
+/* Create key for per-thread workspace. */
+{
+if (pthread_key_create(&workspaceKey, workspaceFree) != 0)
+    errAbort("Couldn't create thread key for gfWorkspace");
+}
+
+struct gfWorkspace *gfWorkspaceForThread()
+/* Return workspace of the calling thread, creating it on first use.
+ * It is freed automatically when the thread exits. */
+{
+struct gfWorkspace *ws;
+pthread_once(&workspaceOnce, workspaceKeyInit);
+if ((ws = pthread_getspecific(workspaceKey)) == NULL)
+    {
+    AllocVar(ws);
+    ws->budgetSplit = 1;
+    ws->lm = lmInit(0);
+    ws->bunHash = newHash(8);
+    ws->seedLm = lmInit(32*1024);
+    ws->outLine = newDyString(512);
+    pthread_setspecific(workspaceKey, ws);
+    }
+return ws;
+}
+
+void gfWorkspaceReset(struct gfWorkspace *ws)
+/* Recycle per-query memory in workspace.  Anything allocated out of
+ * ws->lm or stored in ws->bunHash before the reset is gone afterwards. */
+{
+lmReset(ws->lm);
+lmTrim(ws->lm, gfWorkspaceSpareMax);
+lmTrim(ws->seedLm, gfWorkspaceSpareMax);
+hashClear(ws->bunHash);
+}
+
+static struct gfClump *gfClumpNew()
+/* Return a zeroed clump, reusing one freed earlier in this thread if
+ * possible. */
+{
+struct gfWorkspace *ws = gfWorkspaceForThread();
+struct gfClump *clump = ws->freeClumps;
+if (clump == NULL)
+    AllocVar(clump);
+else
+    {
+    ws->freeClumps = clump->next;
+    ws->freeClumpCount -= 1;
+    ZeroVar(clump);
+    }
+return clump;
+}
+
 void gfClumpFree(struct gfClump **pClump)
-/* Free a single clump. */
+/* Free a single clump.  The memory is kept for reuse by the current
+ * thread, up to a limit. */
 {
 struct gfClump *clump;
+struct gfWorkspace *ws;
 if ((clump = *pClump) == NULL)
     return;
-freez(pClump);
+ws = gfWorkspaceForThread();
+if (ws->freeClumpCount < workspaceFreeClumpMax)
+    {
+    slAddHead(&ws->freeClumps, clump);
+    ws->freeClumpCount += 1;
+    }
+else
+    freeMem(clump);
+*pClump = NULL;
 }
 
 void gfClumpFreeList(struct gfClump **pList)
@@ -1094,13 +1782,22 @@ void gfHitSortDiagonal(struct gfHit **pList)
         struct gfHit *el;
         struct gfHit **array;
         int i;
-        int byteSize = count*sizeof(*array);
+        struct gfWorkspace *ws = gfWorkspaceForThread();
         /* Some variables used by recursive function gfHitSort2
          * across all incarnations. */
         struct gfHit **nosTemp, *nosSwap;
 
-        array = needLargeMem(byteSize);
-        nosTemp = needLargeMem(byteSize);
+        if (count > ws->sortAlloc)
+        {
+            int newAlloc = max(count, 2*ws->sortAlloc);
+            freeMem(ws->sortBuf);
+            freeMem(ws->sortTemp);
+            ws->sortBuf = needLargeMem(newAlloc * sizeof(*array));
+            ws->sortTemp = needLargeMem(newAlloc * sizeof(*array));
+            ws->sortAlloc = newAlloc;
+        }
+        array = ws->sortBuf;
+        nosTemp = ws->sortTemp;
         for (el = list, i=0; el != NULL; el = el->next, i++)
             array[i] = el;
         gfHitSort2(array, count, &nosTemp, &nosSwap);
@@ -1110,8 +1807,6 @@ void gfHitSortDiagonal(struct gfHit **pList)
             array[i]->next = list;
             list = array[i];
         }
-        freez(&array);
-        freez(&nosTemp);
         slReverse(&list);
         *pList = list;
     }
@@ -1278,8 +1973,7 @@ else
 	slReverse(&outList);
 	if (hCount >= gf->minMatch)
 	    {
-	    struct gfClump *newClump;
-	    AllocVar(newClump);
+	    struct gfClump *newClump = gfClumpNew();
 	    newClump->hitList = inList;
 	    newClump->hitCount = hCount;
 	    newClump->target = ss;
@@ -1335,7 +2029,7 @@ for (clump = oldClumps; clump != NULL; clump = nextClump)
 		 clump->hitCount = clumpSize;
 		 findClumpBounds(clump, tileSize);
 		 targetClump(gf, &newClumps, clump);
-		 AllocVar(clump);
+		 clump = gfClumpNew();
 		 }
 	     else
 	         {
@@ -1379,9 +2073,17 @@ int nearEnough = (gf->isPep ? gfNearEnough/3 : gfNearEnough);
 bits32 boundary = bucketSize - nearEnough;
 int i;
 struct gfHit **buckets = NULL, **pb;
+struct gfWorkspace *ws = gfWorkspaceForThread();
 
-/* Sort hit list into buckets. */
-AllocArray(buckets, bucketCount);
+/* Sort hit list into buckets.  Buckets are all left empty after
+ * clumping, so the array can be kept for the next query. */
+if (bucketCount > ws->bucketAlloc)
+    {
+    freeMem(ws->buckets);
+    AllocArray(ws->buckets, bucketCount);
+    ws->bucketAlloc = bucketCount;
+    }
+buckets = ws->buckets;
 for (hit = hitList; hit != NULL; hit = nextHit)
     {
     nextHit = hit->next;
@@ -1424,7 +2126,7 @@ for (i=0; i<bucketCount; ++i)
 	 else if (clumpSize >= minMatch)
 	     {
 	     /* Save clumps that are large enough on list. */
-	     AllocVar(clump);
+	     clump = gfClumpNew();
 	     slAddHead(&clumpList, clump);
 	     clump->hitCount = clumpSize;
 	     clump->hitList = clumpHits;
@@ -1446,48 +2148,332 @@ for (clump = clumpList; clump != NULL; clump = clump->next)	/* uglyf */
     uglyf(" %d %d %s %d %d (%d hits)\n", clump->qStart, clump->qEnd, clump->target->seq->name,   clump->tStart, clump->tEnd, clump->hitCount);
     }
 #endif /* DEBUG */
-freez(&buckets);
 return clumpList;
 }
 
 
-static struct gfHit *gfFastFindDnaHits(struct genoFind *gf, struct dnaSeq *seq, 
-	Bits *qMaskBits,  int qMaskOffset, struct lm *lm, int *retHitCount,
-	struct gfSeqSource *target, int tMin, int tMax)
-/* Find hits associated with one sequence. This is is special fast
- * case for DNA that is in an unsegmented index. */
+#if defined(__GNUC__)
+#define gfPrefetch(p) __builtin_prefetch(p)
+#else
+#define gfPrefetch(p)
+#endif
+
+/* How many tiles ahead of the one being looked up to start fetching
+ * index entries.  List sizes and list pointers are fetched this far
+ * ahead, the start of the lists themselves half as far. */
+#define gfPrefetchAhead 16
+
+boolean gfQueryMayHit(struct genoFind *gf, struct dnaSeq *seq)
+/* Return FALSE if seq can't have gf->minMatch hits on either strand, so
+ * can't have a clump.  This just adds up the position list sizes of its
+ * tiles, without allocating anything.  Always TRUE for kinds of index
+ * this can't judge. */
 {
-struct gfHit *hitList = NULL, *hit;
-int size = seq->size;
-int tileSizeMinusOne = gf->tileSize - 1;
-int mask = gf->tileMask;
+int tileSize = gf->tileSize;
+int minMatch = gf->minMatch;
+bits32 mask = gf->tileMask;
+int rcShift = 2*(tileSize-1);
+bits32 bits = 0, rcBits = 0;
+long hits = 0, rcHits = 0;
 DNA *dna = seq->dna;
-int i, j;
-bits32 bits = 0;
-bits32 bVal;
-int listSize;
-bits32 qStart, *tList;
-int hitCount = 0;
+int i;
 
-for (i=0; i<tileSizeMinusOne; ++i)
-    {
-    bVal = ntValNoN[(int)dna[i]];
-    bits <<= 2;
-    bits += bVal;
+if (gf->segSize != 0 || gf->isPep || gf->allowOneMismatch || gf->seedOffsets != NULL
+	|| gf->sufa != NULL || gf->minimizerWindow > 0)
+    return TRUE;
+for (i=0; i<seq->size; ++i)
+    {
+    /* Bases that aren't a, c, g or t look up as t on both strands. */
+    int val = ntVal[(int)dna[i]];
+    int rcVal = (val < 0 ? T_BASE_VAL : val ^ 2);
+    if (val < 0)
+	val = T_BASE_VAL;
+    bits = ((bits << 2) + val) & mask;
+    rcBits = (rcBits >> 2) | ((bits32)rcVal << rcShift);
+    if (i >= tileSize-1)
+	{
+	hits += gf->listSizes[bits];
+	rcHits += gf->listSizes[rcBits];
+	if (hits >= minMatch || rcHits >= minMatch)
+	    return TRUE;
+	}
     }
-for (i=tileSizeMinusOne; i<size; ++i)
-    {
-    bVal = ntValNoN[(int)dna[i]];
-    bits <<= 2;
-    bits += bVal;
-    bits &= mask;
+return FALSE;
+}
+
+static int hitBudgetCap(int *counts, int count, long budget)
+/* Given the number of hits of each of count lookups, return the most
+ * hits a lookup can have and still be done, such that dropping the ones
+ * with more keeps the total within budget.  Sorts counts. */
+{
+long kept = 0;
+int i = 0;
+intSort(count, counts);
+while (i < count)
+    {
+    int size = counts[i];
+    long sameTotal = 0;
+    while (i < count && counts[i] == size)
+	{
+	sameTotal += size;
+	++i;
+	}
+    if (kept + sameTotal > budget)
+	return size - 1;
+    kept += sameTotal;
+    }
+return counts[count-1];
+}
+
+static void noteHitBudgetCap(char *qName)
+/* Note that a query went over hit budget.  The strands, pieces and frames
+ * of a query all go by its name, so it is only counted once. */
+{
+pthread_mutex_lock(&hitBudgetMutex);
+if (hitBudgetCapped == NULL)
+    hitBudgetCapped = hashNew(0);
+if (hashLookup(hitBudgetCapped, qName) == NULL)
+    hashAdd(hitBudgetCapped, qName, NULL);
+pthread_mutex_unlock(&hitBudgetMutex);
+}
+
+static int *workspaceCounts(struct gfWorkspace *ws, int count)
+/* Return scratch array of at least count ints from workspace. */
+{
+if (count > ws->countAlloc)
+    {
+    freeMem(ws->counts);
+    ws->countAlloc = max(count, 2*ws->countAlloc);
+    ws->counts = needLargeMem(ws->countAlloc * sizeof(ws->counts[0]));
+    }
+return ws->counts;
+}
+
+int *gfHitBudgetCounts(int count)
+/* Return array to fill in with the hits each of count lookups for a query
+ * would make, or NULL if there is no hit budget.  Pass it to
+ * gfHitBudgetListCap before doing the lookups. */
+{
+if (hitBudget <= 0 || count <= 0)
+    return NULL;
+return workspaceCounts(gfWorkspaceForThread(), 2*count);
+}
+
+int gfHitBudgetListCap(char *qName, int *counts, int count)
+/* Given the hits each of count lookups for query would make in counts,
+ * from gfHitBudgetCounts, return the most hits a lookup may make and
+ * still be done within the hit budget.  Lookups that would make more are
+ * to be skipped.  Returns BIGNUM if all fit. */
+{
+struct gfWorkspace *ws = gfWorkspaceForThread();
+long budget = max(1, hitBudget / ws->budgetSplit), total = 0;
+int i;
+for (i=0; i<count; ++i)
+    total += counts[i];
+if (total <= budget)
+    return BIGNUM;
+noteHitBudgetCap(qName);
+memcpy(counts + count, counts, count * sizeof(counts[0]));
+return hitBudgetCap(counts + count, count, budget);
+}
+
+static int fastDnaListCap(struct genoFind *gf, char *qName,
+	bits32 *tiles, int tileCount, Bits *qMaskBits, int qMaskOffset)
+/* Return the largest list size of tile to look up to keep within
+ * hitBudget. */
+{
+int *counts = gfHitBudgetCounts(tileCount);
+int i;
+if (counts == NULL)
+    return BIGNUM;
+for (i=0; i<tileCount; ++i)
+    {
+    int listSize = gf->listSizes[tiles[i]];
+    if (listSize != 0 && qMaskBits != NULL 
+	    && bitCountRange(qMaskBits, i+qMaskOffset, gf->tileSize) != 0)
+	listSize = 0;
+    counts[i] = listSize;
+    }
+return gfHitBudgetListCap(qName, counts, tileCount);
+}
+
+static bits32 *dnaTiles(struct genoFind *gf, struct gfWorkspace *ws, 
+	DNA *dna, int tileCount)
+/* Return tile values of the first tileCount positions of dna in ws->tiles. */
+{
+int tileSizeMinusOne = gf->tileSize - 1;
+int mask = gf->tileMask;
+bits32 *tiles;
+bits32 bits = 0;
+int i, j;
+
+if (tileCount > ws->tileAlloc)
+    {
+    freeMem(ws->tiles);
+    ws->tileAlloc = max(tileCount, 2*ws->tileAlloc);
+    ws->tiles = needLargeMem(ws->tileAlloc * sizeof(ws->tiles[0]));
+    }
+tiles = ws->tiles;
+
+if (gf->seedOffsets != NULL)
+    {
+    int *offsets = gf->seedOffsets;
+    int weight = gf->seedWeight;
+    for (i=0; i<tileCount; ++i)
+	{
+	DNA *pt = dna + i;
+	bits = 0;
+	for (j=0; j<weight; ++j)
+	    {
+	    bits <<= 2;
+	    bits += ntValNoN[(int)pt[offsets[j]]];
+	    }
+	tiles[i] = bits;
+	}
+    }
+else
+    {
+    int size = tileCount + tileSizeMinusOne;
+    for (i=0; i<tileSizeMinusOne; ++i)
+	{
+	bits <<= 2;
+	bits += ntValNoN[(int)dna[i]];
+	}
+    for (i=tileSizeMinusOne; i<size; ++i)
+	{
+	bits <<= 2;
+	bits += ntValNoN[(int)dna[i]];
+	bits &= mask;
+	tiles[i-tileSizeMinusOne] = bits;
+	}
+    }
+return tiles;
+}
+
+static struct gfHit *gfFastFindDnaHits(struct genoFind *gf, struct dnaSeq *seq, 
+	Bits *qMaskBits,  int qMaskOffset, struct lm *lm, int *retHitCount,
+	struct gfSeqSource *target, int tMin, int tMax)
+/* Find hits associated with one sequence. This is is special fast
+ * case for DNA that is in an unsegmented index.  The tiles of the whole
+ * query are computed up front so that the scattered reads into the index
+ * can be prefetched well before they are needed. */
+{
+struct gfHit *hitList = NULL, *hit;
+int size = seq->size;
+DNA *dna = seq->dna;
+int i, j;
+bits32 bits;
+int listSize;
+bits32 qStart, *tList;
+int hitCount = 0;
+struct gfWorkspace *ws = gfWorkspaceForThread();
+bits32 *tiles;
+int tileCount = size - (gf->tileSize - 1);
+void **heads = (gf->packedLists != NULL ? (void **)gf->packedLists : (void **)gf->lists);
+int maxListSize = BIGNUM;
+
+if (tileCount <= 0)
+    {
+    *retHitCount = 0;
+    return NULL;
+    }
+tiles = dnaTiles(gf, ws, dna, tileCount);
+if (target == NULL)
+    maxListSize = fastDnaListCap(gf, seq->name, tiles, tileCount, qMaskBits, qMaskOffset);
+for (i=0; i<gfPrefetchAhead && i<tileCount; ++i)
+    {
+    gfPrefetch(&gf->listSizes[tiles[i]]);
+    gfPrefetch(&heads[tiles[i]]);
+    }
+
+for (qStart=0; qStart<tileCount; ++qStart)
+    {
+    if (qStart + gfPrefetchAhead < tileCount)
+	{
+	bits = tiles[qStart + gfPrefetchAhead];
+	gfPrefetch(&gf->listSizes[bits]);
+	gfPrefetch(&heads[bits]);
+	}
+    if (qStart + gfPrefetchAhead/2 < tileCount)
+	{
+	bits = tiles[qStart + gfPrefetchAhead/2];
+	if (gf->listSizes[bits] != 0)
+	    gfPrefetch(heads[bits]);
+	}
+    bits = tiles[qStart];
     listSize = gf->listSizes[bits];
-    if (listSize != 0)
+    if (listSize != 0 && listSize <= maxListSize)
 	{
-	qStart = i-tileSizeMinusOne;
 	if (qMaskBits == NULL || bitCountRange(qMaskBits, qStart+qMaskOffset, gf->tileSize) == 0)
 	    {
-	    tList = gf->lists[bits];
+	    tList = gfTileList(gf, bits, &ws->listBuf, &ws->listAlloc);
+	    for (j=0; j<listSize; ++j)
+		{
+		int tStart = tList[j];
+		if (target == NULL || 
+			(target == findSource(gf, tStart) && tStart >= tMin && tStart < tMax) ) 
+		    {
+		    lmAllocVar(lm, hit);
+		    hit->qStart = qStart;
+		    hit->tStart = tStart;
+		    hit->diagonal = tStart + size - qStart;
+		    slAddHead(&hitList, hit);
+		    ++hitCount;
+		    }
+		}
+	    }
+	}
+    }
+*retHitCount = hitCount;
+return hitList;
+}
+
+static struct gfHit *gfMinimizerFindHits(struct genoFind *gf, struct dnaSeq *seq, 
+	Bits *qMaskBits,  int qMaskOffset, struct lm *lm, int *retHitCount,
+	struct gfSeqSource *target, int tMin, int tMax)
+/* Find hits associated with one sequence in an index of minimizers.
+ * Only the minimizers of the query need to be looked up, since any
+ * window the query shares with the target has the same minimizer in
+ * both. */
+{
+struct gfHit *hitList = NULL, *hit;
+struct gfWorkspace *ws = gfWorkspaceForThread();
+struct minimizerScan scan;
+int size = seq->size;
+int tileSize = gf->tileSize;
+int j, tile, pos;
+int listSize;
+bits32 qStart, *tList;
+int hitCount = 0;
+int *counts = NULL, maxCount = BIGNUM, scanCount = 0;
+
+initNtLookup();
+if (target == NULL && (counts = gfHitBudgetCounts(size)) != NULL)
+    {
+    /* Scan once just to add up list sizes, then again to look them up. */
+    minimizerScanInit(&scan, gf, seq->dna, size);
+    while (minimizerScanNext(&scan, &tile, &pos))
+	{
+	listSize = gf->listSizes[tile];
+	if (qMaskBits != NULL && bitCountRange(qMaskBits, pos+qMaskOffset, tileSize) != 0)
+	    listSize = 0;
+	counts[scanCount++] = listSize;
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, scanCount);
+    scanCount = 0;
+    }
+minimizerScanInit(&scan, gf, seq->dna, size);
+while (minimizerScanNext(&scan, &tile, &pos))
+    {
+    listSize = gf->listSizes[tile];
+    if (counts != NULL && counts[scanCount++] > maxCount)
+	continue;
+    if (listSize != 0)
+	{
+	qStart = pos;
+	if (qMaskBits == NULL || bitCountRange(qMaskBits, qStart+qMaskOffset, tileSize) == 0)
+	    {
+	    tList = gfTileList(gf, tile, &ws->listBuf, &ws->listAlloc);
 	    for (j=0; j<listSize; ++j)
 		{
 		int tStart = tList[j];
@@ -1526,10 +2512,26 @@ int listSize;
 bits32 qStart, *tList;
 int hitCount = 0;
 int (*makeTile)(char *poly, int n) = (gf->isPep ? gfPepTile : gfDnaTile);
+int *counts = NULL, maxCount = BIGNUM;
 
 initNtLookup();
+if (target == NULL && (counts = gfHitBudgetCounts(lastStart+1)) != NULL)
+    {
+    for (i=0; i<=lastStart; ++i)
+	{
+	tile = makeTile(poly+i, tileSize);
+	if (tile < 0 || (qMaskBits != NULL 
+		&& bitCountRange(qMaskBits, i+qMaskOffset, tileSize) != 0))
+	    counts[i] = 0;
+	else
+	    counts[i] = gf->listSizes[tile];
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, lastStart+1);
+    }
 for (i=0; i<=lastStart; ++i)
     {
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
     tile = makeTile(poly+i, tileSize);
     if (tile < 0)
 	continue;
@@ -1539,7 +2541,8 @@ for (i=0; i<=lastStart; ++i)
 	qStart = i;
 	if (qMaskBits == NULL || bitCountRange(qMaskBits, qStart+qMaskOffset, tileSize) == 0)
 	    {
-	    tList = gf->lists[tile];
+	    struct gfWorkspace *ws = gfWorkspaceForThread();
+	    tList = gfTileList(gf, tile, &ws->listBuf, &ws->listAlloc);
 	    for (j=0; j<listSize; ++j)
 		{
 		int tStart = tList[j];
@@ -1561,6 +2564,72 @@ for (i=0; i<=lastStart; ++i)
 return hitList;
 }
 
+#define gfMaxAnyNearTiles (8*20)	/* Most one-off variants of a peptide tile. */
+
+static void nearAlphabet(struct genoFind *gf, int (**retMakeTile)(char *poly, int n),
+	int *retAlphabetSize, char *retZeroChar, int **retSeqValLookup)
+/* Return how to make tiles and vary their letters for gf. */
+{
+if (gf->isPep)
+    {
+    *retMakeTile = gfPepTile;
+    *retAlphabetSize = 20;
+    *retZeroChar = 'A';
+    *retSeqValLookup = aaVal;
+    }
+else
+    {
+    *retMakeTile = gfDnaTile;
+    *retAlphabetSize = 4;
+    *retZeroChar = 't';
+    *retSeqValLookup = ntVal;
+    }
+}
+
+static int gfStraightNearTiles(struct genoFind *gf, char *poly, int *tiles)
+/* Put all tiles within one mismatch of the one at poly into tiles, and
+ * return how many there are. */
+{
+int tileSize = gf->tileSize;
+int count = 0;
+int tile;
+int varPos, varVal;	/* Variable position. */
+int (*makeTile)(char *poly, int n); 
+int alphabetSize;
+char oldChar, zeroChar;
+int *seqValLookup;
+int posMul = 1, avoid;
+
+nearAlphabet(gf, &makeTile, &alphabetSize, &zeroChar, &seqValLookup);
+for (varPos = tileSize-1; varPos >=0; --varPos)
+    {
+    /* Make a tile that has zero value at variable position. */
+    oldChar = poly[varPos];
+    poly[varPos] = zeroChar;
+    tile = makeTile(poly, tileSize);
+    poly[varPos] = oldChar;
+
+    /* Avoid checking the unmodified tile multiple times. */
+    if (varPos == 0)
+	avoid = -1;
+    else
+	avoid = seqValLookup[(int)oldChar];
+
+    if (tile >= 0)
+	{
+	/* Take all possible values of variable position. */
+	for (varVal=0; varVal<alphabetSize; ++varVal)
+	    {
+	    if (varVal != avoid)
+		tiles[count++] = tile;
+	    tile += posMul;
+	    }
+	}
+    posMul *= alphabetSize;
+    }
+return count;
+}
+
 static struct gfHit *gfStraightFindNearHits(struct genoFind *gf, aaSeq *seq, 
 	Bits *qMaskBits, int qMaskOffset, struct lm *lm, int *retHitCount,
 	struct gfSeqSource *target, int tMin, int tMax)
@@ -1572,87 +2641,200 @@ int size = seq->size;
 int tileSize = gf->tileSize;
 int lastStart = size - tileSize;
 char *poly = seq->dna;
-int i, j;
-int tile;
+int i, j, k;
+int tiles[gfMaxAnyNearTiles], tileCount;
 int listSize;
 bits32 qStart, *tList;
 int hitCount = 0;
-int varPos, varVal;	/* Variable position. */
-int (*makeTile)(char *poly, int n); 
-int alphabetSize;
-char oldChar, zeroChar;
-int *seqValLookup;
-int posMul, avoid;
+int *counts = NULL, maxCount = BIGNUM;
 
 initNtLookup();
-if (gf->isPep)
+if (target == NULL && (counts = gfHitBudgetCounts(lastStart+1)) != NULL)
     {
-    makeTile = gfPepTile;
-    alphabetSize = 20;
-    zeroChar = 'A';
-    seqValLookup = aaVal;
+    for (i=0; i<=lastStart; ++i)
+	{
+	counts[i] = 0;
+	if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
+	    {
+	    tileCount = gfStraightNearTiles(gf, poly+i, tiles);
+	    for (k=0; k<tileCount; ++k)
+		counts[i] += gf->listSizes[tiles[k]];
+	    }
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, lastStart+1);
     }
-else
+for (i=0; i<=lastStart; ++i)
     {
-    makeTile = gfDnaTile;
-    alphabetSize = 4;
-    zeroChar = 't';
-    seqValLookup = ntVal;
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
+    tileCount = gfStraightNearTiles(gf, poly+i, tiles);
+    for (k=0; k<tileCount; ++k)
+	{
+	int tile = tiles[k];
+	listSize = gf->listSizes[tile];
+	if (listSize > 0)
+	    {
+	    qStart = i;
+	    if (qMaskBits == NULL || bitCountRange(qMaskBits, qStart+qMaskOffset, tileSize) == 0)
+		{
+		struct gfWorkspace *ws = gfWorkspaceForThread();
+		tList = gfTileList(gf, tile, &ws->listBuf, &ws->listAlloc);
+		for (j=0; j<listSize; ++j)
+		    {
+		    int tStart = tList[j];
+		    if (target == NULL || 
+			    (target == findSource(gf, tStart) 
+			    && tStart >= tMin && tStart < tMax) ) 
+			{
+			lmAllocVar(lm,hit);
+			hit->qStart = qStart;
+			hit->tStart = tStart;
+			hit->diagonal = tStart + size - qStart;
+			slAddHead(&hitList, hit);
+			++hitCount;
+			}
+		    }
+		}
+	    }
+	}
     }
+*retHitCount = hitCount;
+return hitList;
+}
 
-for (i=0; i<=lastStart; ++i)
+#define gfMaxNearTiles (4*12+1)	/* Most one-off variants of a DNA tile. */
+
+static int gfDnaNearTiles(DNA *dna, int tileSize, int *tiles)
+/* Put all tiles within one mismatch of the one at dna into tiles, and
+ * return how many there are.  These are the same tiles in the same
+ * order as gfStraightFindNearHits would look up, so that the hit lists
+ * come out identical.  A base that can't be part of a tile (an N or a
+ * masked upper case base) may be varied, but only if it's the only one. */
+{
+int count = 0;
+int i, badPos = -1;
+int baseTile = 0;
+int varPos, varVal, avoid;
+
+for (i=0; i<tileSize; ++i)
     {
-    posMul = 1;
-    for (varPos = tileSize-1; varPos >=0; --varPos)
+    int c = ntLookup[(int)dna[i]];
+    baseTile <<= 2;
+    if (c < 0)
 	{
-	/* Make a tile that has zero value at variable position. */
-	oldChar = poly[i+varPos];
-	poly[i+varPos] = zeroChar;
-	tile = makeTile(poly+i, tileSize);
-	poly[i+varPos] = oldChar;
+	if (badPos >= 0)
+	    return 0;
+	badPos = i;
+	}
+    else
+	baseTile += c;
+    }
+for (varPos = tileSize-1; varPos >= 0; --varPos)
+    {
+    int shift = 2*(tileSize-1-varPos);
+    int zeroTile;
+    if (badPos >= 0 && badPos != varPos)
+	continue;
+    zeroTile = baseTile & ~(3<<shift);
+    /* Avoid checking the unmodified tile multiple times. */
+    avoid = (varPos == 0 ? -1 : ntVal[(int)dna[varPos]]);
+    for (varVal=0; varVal<4; ++varVal)
+	{
+	if (varVal != avoid)
+	    tiles[count++] = zeroTile + (varVal<<shift);
+	}
+    }
+return count;
+}
 
-	/* Avoid checking the unmodified tile multiple times. */
-	if (varPos == 0)
-	    avoid = -1;
-	else
-	    avoid = seqValLookup[(int)oldChar];
+static struct gfHit *gfFastFindDnaNearHits(struct genoFind *gf, struct dnaSeq *seq, 
+	Bits *qMaskBits, int qMaskOffset, struct lm *lm, int *retHitCount,
+	struct gfSeqSource *target, int tMin, int tMax)
+/* Find hits associated with one sequence in a non-segmented DNA index
+ * where hits can mismatch in one base.  This is a special fast case of
+ * gfStraightFindNearHits.  All the variants of the next query tile are
+ * worked out and their index entries prefetched while those of the
+ * current tile are looked up.  The variants of a tile are all different,
+ * so they never lead to the same hit twice. */
+{
+struct gfHit *hitList = NULL, *hit;
+struct gfWorkspace *ws = gfWorkspaceForThread();
+int size = seq->size;
+int tileSize = gf->tileSize;
+int lastStart = size - tileSize;
+DNA *dna = seq->dna;
+int nearBuf[2][gfMaxNearTiles];
+int *curTiles = nearBuf[0], *nextTiles = nearBuf[1], *swapTiles;
+int curCount, nextCount = 0;
+void **heads = (gf->packedLists != NULL ? (void **)gf->packedLists : (void **)gf->lists);
+int i, j, k;
+int listSize;
+bits32 *tList;
+int hitCount = 0;
+int *counts = NULL, maxCount = BIGNUM;
 
-	if (tile >= 0)
+initNtLookup();
+if (target == NULL && (counts = gfHitBudgetCounts(lastStart+1)) != NULL)
+    {
+    for (i=0; i<=lastStart; ++i)
+	{
+	counts[i] = 0;
+	if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
 	    {
-	    /* Look up all possible values of variable position. */
-	    for (varVal=0; varVal<alphabetSize; ++varVal)
+	    curCount = gfDnaNearTiles(dna+i, tileSize, curTiles);
+	    for (k=0; k<curCount; ++k)
+		counts[i] += gf->listSizes[curTiles[k]];
+	    }
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, lastStart+1);
+    }
+if (lastStart >= 0)
+    nextCount = gfDnaNearTiles(dna, tileSize, nextTiles);
+for (i=0; i<=lastStart; ++i)
+    {
+    swapTiles = curTiles;
+    curTiles = nextTiles;
+    nextTiles = swapTiles;
+    curCount = nextCount;
+    nextCount = 0;
+    if (i < lastStart)
+	{
+	nextCount = gfDnaNearTiles(dna+i+1, tileSize, nextTiles);
+	for (k=0; k<nextCount; ++k)
+	    {
+	    gfPrefetch(&gf->listSizes[nextTiles[k]]);
+	    gfPrefetch(&heads[nextTiles[k]]);
+	    }
+	}
+    if (curCount == 0)
+	continue;
+    if (qMaskBits != NULL && bitCountRange(qMaskBits, i+qMaskOffset, tileSize) != 0)
+	continue;
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
+    for (k=0; k<curCount; ++k)
+	{
+	int tile = curTiles[k];
+	listSize = gf->listSizes[tile];
+	if (listSize > 0)
+	    {
+	    tList = gfTileList(gf, tile, &ws->listBuf, &ws->listAlloc);
+	    for (j=0; j<listSize; ++j)
 		{
-		if (varVal != avoid)
+		int tStart = tList[j];
+		if (target == NULL || 
+			(target == findSource(gf, tStart) 
+			&& tStart >= tMin && tStart < tMax) ) 
 		    {
-		    listSize = gf->listSizes[tile];
-		    if (listSize > 0)
-			{
-			qStart = i;
-			if (qMaskBits == NULL || bitCountRange(qMaskBits, qStart+qMaskOffset, tileSize) == 0)
-			    {
-			    tList = gf->lists[tile];
-			    for (j=0; j<listSize; ++j)
-				{
-				int tStart = tList[j];
-				if (target == NULL || 
-					(target == findSource(gf, tStart) 
-					&& tStart >= tMin && tStart < tMax) ) 
-				    {
-				    lmAllocVar(lm,hit);
-				    hit->qStart = qStart;
-				    hit->tStart = tStart;
-				    hit->diagonal = tStart + size - qStart;
-				    slAddHead(&hitList, hit);
-				    ++hitCount;
-				    }
-				}
-			    }
-			}
+		    lmAllocVar(lm,hit);
+		    hit->qStart = i;
+		    hit->tStart = tStart;
+		    hit->diagonal = tStart + size - i;
+		    slAddHead(&hitList, hit);
+		    ++hitCount;
 		    }
-		tile += posMul;
 		}
 	    }
-	posMul *= alphabetSize;
 	}
     }
 *retHitCount = hitCount;
@@ -1679,11 +2861,30 @@ bits32 qStart;
 bits16 *endList;
 int hitCount = 0;
 int (*makeTile)(char *poly, int n) = (gf->isPep ? gfPepTile : gfDnaTile);
+int *counts = NULL, maxCount = BIGNUM;
 
 
 initNtLookup();
+if (target == NULL && (counts = gfHitBudgetCounts(lastStart+1)) != NULL)
+    {
+    /* The whole list of the head is walked to find hits, so count that. */
+    for (i=0; i<=lastStart; ++i)
+	{
+	counts[i] = 0;
+	if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
+	    {
+	    tileHead = makeTile(poly+i, tileHeadSize);
+	    tileTail = makeTile(poly+i+tileHeadSize, tileTailSize);
+	    if (tileHead >= 0 && tileTail >= 0)
+		counts[i] = gf->listSizes[tileHead];
+	    }
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, lastStart+1);
+    }
 for (i=0; i<=lastStart; ++i)
     {
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
     if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
 	{
 	tileHead = makeTile(poly+i, tileHeadSize);
@@ -1720,6 +2921,65 @@ for (i=0; i<=lastStart; ++i)
 return hitList;
 }
 
+static int gfSegmentedNearTiles(struct genoFind *gf, char *poly, 
+	int *heads, int *tails)
+/* Put the head and tail parts of all tiles within one mismatch of the
+ * one at poly into heads and tails, and return how many there are. */
+{
+int tileSize = gf->tileSize;
+int tileTailSize = gf->segSize;
+int tileHeadSize = gf->tileSize - tileTailSize;
+int count = 0;
+int tileHead, tileTail;
+int varPos, varVal;	/* Variable position. */
+int (*makeTile)(char *poly, int n); 
+int alphabetSize;
+char oldChar, zeroChar;
+int headPosMul = 1, tailPosMul = 1, avoid;
+boolean modTail;
+int *seqValLookup;
+
+nearAlphabet(gf, &makeTile, &alphabetSize, &zeroChar, &seqValLookup);
+for (varPos = tileSize-1; varPos >= 0; --varPos)
+    {
+    /* Make a tile that has zero value at variable position. */
+    modTail = (varPos >= tileHeadSize);
+    oldChar = poly[varPos];
+    poly[varPos] = zeroChar;
+    tileHead = makeTile(poly, tileHeadSize);
+    tileTail = makeTile(poly+tileHeadSize, tileTailSize);
+    poly[varPos] = oldChar;
+
+    /* Avoid checking the unmodified tile multiple times. */
+    if (varPos == 0)
+	avoid = -1;
+    else
+	avoid = seqValLookup[(int)oldChar];
+
+    if (tileHead >= 0 && tileTail >= 0)
+	{
+	for (varVal=0; varVal<alphabetSize; ++varVal)
+	    {
+	    if (varVal != avoid)
+		{
+		heads[count] = tileHead;
+		tails[count] = tileTail;
+		++count;
+		}
+	    if (modTail)
+		tileTail += tailPosMul;
+	    else 
+		tileHead += headPosMul;
+	    }
+	}
+    if (modTail)
+	tailPosMul *= alphabetSize;
+    else 
+	headPosMul *= alphabetSize;
+    }
+return count;
+}
+
 static struct gfHit *gfSegmentedFindNearHits(struct genoFind *gf, 
 	aaSeq *seq, Bits *qMaskBits, int qMaskOffset, struct lm *lm, int *retHitCount,
 	struct gfSeqSource *target, int tMin, int tMax)
@@ -1729,101 +2989,64 @@ static struct gfHit *gfSegmentedFindNearHits(struct genoFind *gf,
 struct gfHit *hitList = NULL, *hit;
 int size = seq->size;
 int tileSize = gf->tileSize;
-int tileTailSize = gf->segSize;
-int tileHeadSize = gf->tileSize - tileTailSize;
 int lastStart = size - tileSize;
 char *poly = seq->dna;
-int i, j;
-int tileHead, tileTail;
+int i, j, k;
+int heads[gfMaxAnyNearTiles], tails[gfMaxAnyNearTiles], tileCount;
 int listSize;
 bits32 qStart;
 bits16 *endList;
 int hitCount = 0;
-int varPos, varVal;	/* Variable position. */
-int (*makeTile)(char *poly, int n); 
-int alphabetSize;
-char oldChar, zeroChar;
-int headPosMul, tailPosMul, avoid;
-boolean modTail;
-int *seqValLookup;
+int *counts = NULL, maxCount = BIGNUM;
 
 
 initNtLookup();
-if (gf->isPep)
-    {
-    makeTile = gfPepTile;
-    alphabetSize = 20;
-    zeroChar = 'A';
-    seqValLookup = aaVal;
-    }
-else
+if (target == NULL && (counts = gfHitBudgetCounts(lastStart+1)) != NULL)
     {
-    makeTile = gfDnaTile;
-    alphabetSize = 4;
-    zeroChar = 't';
-    seqValLookup = ntVal;
+    for (i=0; i<=lastStart; ++i)
+	{
+	counts[i] = 0;
+	if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
+	    {
+	    tileCount = gfSegmentedNearTiles(gf, poly+i, heads, tails);
+	    for (k=0; k<tileCount; ++k)
+		counts[i] += gf->listSizes[heads[k]];
+	    }
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, lastStart+1);
     }
-
 for (i=0; i<=lastStart; ++i)
     {
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
     if (qMaskBits == NULL || bitCountRange(qMaskBits, i+qMaskOffset, tileSize) == 0)
 	{
-	headPosMul = tailPosMul = 1;
-	for (varPos = tileSize-1; varPos >= 0; --varPos)
+	tileCount = gfSegmentedNearTiles(gf, poly+i, heads, tails);
+	for (k=0; k<tileCount; ++k)
 	    {
-	    /* Make a tile that has zero value at variable position. */
-	    modTail = (varPos >= tileHeadSize);
-	    oldChar = poly[i+varPos];
-	    poly[i+varPos] = zeroChar;
-	    tileHead = makeTile(poly+i, tileHeadSize);
-	    tileTail = makeTile(poly+i+tileHeadSize, tileTailSize);
-	    poly[i+varPos] = oldChar;
-
-	    /* Avoid checking the unmodified tile multiple times. */
-	    if (varPos == 0)
-		avoid = -1;
-	    else
-		avoid = seqValLookup[(int)oldChar];
-
-	    if (tileHead >= 0 && tileTail >= 0)
+	    int tileTail = tails[k];
+	    listSize = gf->listSizes[heads[k]];
+	    qStart = i;
+	    endList = gf->endLists[heads[k]];
+	    for (j=0; j<listSize; ++j)
 		{
-		for (varVal=0; varVal<alphabetSize; ++varVal)
+		if (endList[0] == tileTail)
 		    {
-		    if (varVal != avoid)
+		    int tStart = (endList[1]<<16) + endList[2];
+		    if (target == NULL || 
+			    (target == findSource(gf, tStart) 
+			    && tStart >= tMin && tStart < tMax) ) 
 			{
-			listSize = gf->listSizes[tileHead];
-			qStart = i;
-			endList = gf->endLists[tileHead];
-			for (j=0; j<listSize; ++j)
-			    {
-			    if (endList[0] == tileTail)
-				{
-				int tStart = (endList[1]<<16) + endList[2];
-				if (target == NULL || 
-					(target == findSource(gf, tStart) 
-					&& tStart >= tMin && tStart < tMax) ) 
-				    {
-				    lmAllocVar(lm,hit);
-				    hit->qStart = qStart;
-				    hit->tStart = tStart;
-				    hit->diagonal = tStart + size - qStart;
-				    slAddHead(&hitList, hit);
-				    ++hitCount;
-				    }
-				}
-			    endList += 3;
-			    }
+			lmAllocVar(lm,hit);
+			hit->qStart = qStart;
+			hit->tStart = tStart;
+			hit->diagonal = tStart + size - qStart;
+			slAddHead(&hitList, hit);
+			++hitCount;
 			}
-		    if (modTail)
-			tileTail += tailPosMul;
-		    else 
-			tileHead += headPosMul;
 		    }
+		endList += 3;
 		}
-	    if (modTail)
-		tailPosMul *= alphabetSize;
-	    else 
-		headPosMul *= alphabetSize;
 	    }
 	}
     }
@@ -1839,7 +3062,17 @@ static struct gfHit *gfFindHitsWithQmask(struct genoFind *gf, bioSeq *seq,
  * The hits will be in genome rather than chromosome coordinates. */
 {
 struct gfHit *hitList = NULL;
-if (gf->segSize == 0 && !gf->isPep && !gf->allowOneMismatch)
+if (gf->sufa != NULL)
+    {
+    hitList = gfSufaFindHits(gf, seq, qMaskBits, qMaskOffset, lm, retHitCount,
+	target, tMin, tMax);
+    }
+else if (gf->minimizerWindow > 0)
+    {
+    hitList = gfMinimizerFindHits(gf, seq, qMaskBits, qMaskOffset, lm, retHitCount,
+	target, tMin, tMax);
+    }
+else if (gf->segSize == 0 && !gf->isPep && !gf->allowOneMismatch)
     {
     hitList = gfFastFindDnaHits(gf, seq, qMaskBits, qMaskOffset, lm, retHitCount,
 	target, tMin, tMax);
@@ -1848,7 +3081,12 @@ else
     {
     if (gf->segSize == 0)
 	{
-	if (gf->allowOneMismatch)
+	if (gf->allowOneMismatch && !gf->isPep)
+	    {
+	    hitList = gfFastFindDnaNearHits(gf, seq, qMaskBits, qMaskOffset, lm, 
+		retHitCount, target, tMin, tMax);
+	    }
+	else if (gf->allowOneMismatch)
 	    {
 	    hitList = gfStraightFindNearHits(gf, seq, qMaskBits, qMaskOffset, lm, 
 		retHitCount, target, tMin, tMax);
@@ -1918,6 +3156,133 @@ struct gfClump *gfFindClumpsWithQmask(struct genoFind *gf, bioSeq *seq,
     return clumpList;
 }
 
+struct batchTile
+/* A tile of one of a batch of sequences, and the hits found for it. */
+    {
+    bits32 tile;		/* Tile value. */
+    int seqIx;			/* Index of sequence in batch. */
+    int qStart;			/* Position of tile in sequence. */
+    struct gfHit *hitList;	/* Hits of tile, last position in list first. */
+    struct gfHit *lastHit;	/* Last hit in hitList. */
+    };
+
+static int batchTileCmp(const void *va, const void *vb)
+/* Compare to sort batch tiles on tile value. */
+{
+const struct batchTile *a = *((struct batchTile **)va);
+const struct batchTile *b = *((struct batchTile **)vb);
+if (a->tile < b->tile)
+    return -1;
+return (a->tile > b->tile);
+}
+
+void gfFindClumpsBatch(struct genoFind *gf, struct dnaSeq **seqs, Bits **qMaskBits,
+	int seqCount, struct lm *lm, struct gfClump **retClumps)
+/* Find clumps of each of seqs, as gfFindClumpsWithQmask would with a
+ * qMaskOffset of zero, and put those of seqs[i] in retClumps[i].  For
+ * unsegmented DNA indexes, spaced seed ones included, the tiles of the
+ * whole batch are looked up together in order of tile value, so each
+ * position list is read once per batch, and the index is walked in order.
+ * Other indexes (segmented, one-off, suffix array or minimizer) are
+ * searched a sequence at a time.  Hits and tiles are allocated from lm. */
+{
+struct batchTile **tileStarts, *batchTiles, **sorted, *bt;
+int *tileCounts;
+int i, j, totalTiles = 0, usedTiles = 0;
+struct gfWorkspace *ws = gfWorkspaceForThread();
+
+if (gf->segSize != 0 || gf->isPep || gf->allowOneMismatch 
+	|| gf->sufa != NULL || gf->minimizerWindow > 0)
+    {
+    int hitCount;
+    for (i=0; i<seqCount; ++i)
+	retClumps[i] = gfFindClumpsWithQmask(gf, seqs[i], qMaskBits[i], 0, lm, &hitCount);
+    return;
+    }
+
+/* Make up tiles of each sequence that are in index, in the order the
+ * single sequence case looks them up. */
+lmAllocArray(lm, tileStarts, seqCount);
+lmAllocArray(lm, tileCounts, seqCount);
+for (i=0; i<seqCount; ++i)
+    totalTiles += max(0, seqs[i]->size - (gf->tileSize - 1));
+lmAllocArray(lm, batchTiles, max(totalTiles, 1));
+for (i=0; i<seqCount; ++i)
+    {
+    struct dnaSeq *seq = seqs[i];
+    int tileCount = seq->size - (gf->tileSize - 1);
+    int maxListSize = BIGNUM;
+    bits32 *tiles;
+    tileStarts[i] = batchTiles + usedTiles;
+    tileCounts[i] = 0;
+    if (tileCount <= 0)
+	continue;
+    tiles = dnaTiles(gf, ws, seq->dna, tileCount);
+    maxListSize = fastDnaListCap(gf, seq->name, tiles, tileCount, qMaskBits[i], 0);
+    for (j=0; j<tileCount; ++j)
+	{
+	int listSize = gf->listSizes[tiles[j]];
+	if (listSize != 0 && listSize <= maxListSize && (qMaskBits[i] == NULL 
+		|| bitCountRange(qMaskBits[i], j, gf->tileSize) == 0))
+	    {
+	    bt = &batchTiles[usedTiles++];
+	    bt->tile = tiles[j];
+	    bt->seqIx = i;
+	    bt->qStart = j;
+	    tileCounts[i] += 1;
+	    }
+	}
+    }
+
+/* Look up tiles in order of value.  The hits of each are made in list
+ * order and added to head, as in the single sequence case. */
+lmAllocArray(lm, sorted, max(usedTiles, 1));
+for (i=0; i<usedTiles; ++i)
+    sorted[i] = &batchTiles[i];
+qsort(sorted, usedTiles, sizeof(sorted[0]), batchTileCmp);
+for (i=0; i<usedTiles; )
+    {
+    bits32 tile = sorted[i]->tile;
+    int listSize = gf->listSizes[tile];
+    bits32 *tList = gfTileList(gf, tile, &ws->listBuf, &ws->listAlloc);
+    for (; i<usedTiles && sorted[i]->tile == tile; ++i)
+	{
+	struct gfHit *hit, *hitList = NULL, *lastHit = NULL;
+	int qStart, size;
+	bt = sorted[i];
+	qStart = bt->qStart;
+	size = seqs[bt->seqIx]->size;
+	for (j=0; j<listSize; ++j)
+	    {
+	    int tStart = tList[j];
+	    lmAllocVar(lm, hit);
+	    hit->qStart = qStart;
+	    hit->tStart = tStart;
+	    hit->diagonal = tStart + size - qStart;
+	    if (lastHit == NULL)
+		lastHit = hit;
+	    slAddHead(&hitList, hit);
+	    }
+	bt->hitList = hitList;
+	bt->lastHit = lastHit;
+	}
+    }
+
+/* Join hits of each sequence up in the order the single sequence case
+ * would have them, and clump. */
+for (i=0; i<seqCount; ++i)
+    {
+    struct gfHit *hitList = NULL;
+    for (j=0; j<tileCounts[i]; ++j)
+	{
+	bt = &tileStarts[i][j];
+	bt->lastHit->next = hitList;
+	hitList = bt->hitList;
+	}
+    retClumps[i] = clumpHits(gf, hitList, gf->minMatch);
+    }
+}
+
 struct gfHit *gfFindHitsInRegion(struct genoFind *gf, bioSeq *seq, 
 	Bits *qMaskBits, int qMaskOffset, struct lm *lm, 
 	struct gfSeqSource *target, int tMin, int tMax)
@@ -1948,14 +3313,18 @@ return gfFindClumpsWithQmask(gf, seq, NULL, 0, lm, retHitCount);
 void gfTransFindClumps(struct genoFind *gfs[3], aaSeq *seq, struct gfClump *clumps[3], struct lm *lm, int *retHitCount)
 /* Find clumps associated with one sequence in three translated reading frames. */
 {
+struct gfWorkspace *ws = gfWorkspaceForThread();
 int frame;
 int oneHit;
 int hitCount = 0;
+/* The frames share the query's hit budget. */
+ws->budgetSplit *= 3;
 for (frame = 0; frame < 3; ++frame)
     {
     clumps[frame] = gfFindClumps(gfs[frame], seq, lm, &oneHit);
     hitCount += oneHit;
     }
+ws->budgetSplit /= 3;
 *retHitCount = hitCount;
 }
 
@@ -1964,15 +3333,18 @@ void gfTransTransFindClumps(struct genoFind *gfs[3], aaSeq *seqs[3],
 /* Find clumps associated with three sequences in three translated 
  * reading frames. Used for translated/translated protein comparisons. */
 {
+struct gfWorkspace *ws = gfWorkspaceForThread();
 int qFrame;
 int oneHit;
 int hitCount = 0;
 
+ws->budgetSplit *= 3;
 for (qFrame = 0; qFrame<3; ++qFrame)
     {
     gfTransFindClumps(gfs, seqs[qFrame], clumps[qFrame], lm, &oneHit);
     hitCount += oneHit;
     }
+ws->budgetSplit /= 3;
 *retHitCount = hitCount;
 }
 
@@ -2121,6 +3493,8 @@ int *rTiles, rTile;
 int rTileCount = rPrimerSize - tileSize;
 int fTileIx,rTileIx,fPosIx,rPosIx;
 bits32 *fPosList, fPos, *rPosList, rPos;
+bits32 *fBuf = NULL, *rBuf = NULL;	/* Decoded lists if index is packed. */
+int fBufAlloc = 0, rBufAlloc = 0;
 int fPosListSize, rPosListSize;
 struct hash *targetHash = newHash(0);
 
@@ -2140,7 +3514,7 @@ for (fTileIx=0; fTileIx<fTileCount; ++fTileIx)
     if (fTile >= 0)
         {
 	fPosListSize = gf->listSizes[fTile];
-	fPosList = gf->lists[fTile];
+	fPosList = gfTileList(gf, fTile, &fBuf, &fBufAlloc);
 	for (fPosIx=0; fPosIx < fPosListSize; ++fPosIx)
 	    {
 	    fPos = fPosList[fPosIx];
@@ -2149,7 +3523,7 @@ for (fTileIx=0; fTileIx<fTileCount; ++fTileIx)
 	        {
 		rTile = rTiles[rTileIx];
 		rPosListSize = gf->listSizes[rTile];
-		rPosList = gf->lists[rTile];
+		rPosList = gfTileList(gf, rTile, &rBuf, &rBufAlloc);
 		for (rPosIx=0; rPosIx < rPosListSize; ++rPosIx)
 		    {
 		    rPos = rPosList[rPosIx];
@@ -2206,6 +3580,8 @@ for (fTileIx=0; fTileIx<fTileCount; ++fTileIx)
     hashFree(&targetHash);
     }
 freez(&rTiles);
+freeMem(fBuf);
+freeMem(rBuf);
 return clumpList;	
 }
 
@@ -16,10 +16,12 @@
 #include "nib.h"
 #include "twoBit.h"
 #include "trans3.h"
+#include "quickHeap.h"
 
 
 
 static int ssAliCount = 16;	/* Number of alignments returned by ssStitch. */
+static int bestN = 0;		/* If non-zero extend only about this many clumps a query. */
 
 #ifdef DEBUG
 void dumpRange(struct gfRange *r, FILE *f)
@@ -44,7 +46,8 @@ void gfRangeFree(struct gfRange **pEl)
 struct gfRange *el;
 
 if ((el = *pEl) == NULL) return;
-freeMem(el->tName);
+if (el->tId == 0)
+    freeMem(el->tName);
 if (el->components != NULL)
     gfRangeFreeList(&el->components);
 freez(pEl);
@@ -86,7 +89,10 @@ const struct gfRange *a = *((struct gfRange **)va);
 const struct gfRange *b = *((struct gfRange **)vb);
 int diff;
 
-diff = strcmp(a->tName, b->tName);
+if (a->tId != 0 && b->tId != 0)
+    diff = a->tId - b->tId;
+else
+    diff = strcmp(a->tName, b->tName);
 if (diff == 0)
     {
     long lDiff = a->t3 - b->t3;
@@ -352,6 +358,14 @@ else
 
 
 
+static boolean sameTarget(struct gfRange *a, struct gfRange *b)
+/* Return TRUE if ranges are on same target sequence. */
+{
+if (a->tId != 0 && b->tId != 0)
+    return a->tId == b->tId;
+return sameString(a->tName, b->tName);
+}
+
 struct gfRange *gfRangesBundle(struct gfRange *exonList, int maxIntron)
 /* Bundle a bunch of 'exons' into plausable 'genes'.  It's
  * not necessary to be precise here.  The main thing is to
@@ -363,14 +377,15 @@ struct gfRange *geneList = NULL, *gene = NULL, *lastExon = NULL, *exon, *nextExo
 for (exon = exonList; exon != NULL; exon = nextExon)
     {
     nextExon = exon->next;
-    if (lastExon == NULL || !sameString(lastExon->tName, exon->tName) 
+    if (lastExon == NULL || !sameTarget(lastExon, exon)
 	|| exon->t3  != lastExon->t3
         || exon->tStart - lastExon->tEnd > maxIntron)
 	{
 	AllocVar(gene);
 	gene->tStart = exon->tStart;
 	gene->tEnd = exon->tEnd;
-	gene->tName = cloneString(exon->tName);
+	gene->tId = exon->tId;
+	gene->tName = (exon->tId != 0 ? exon->tName : cloneString(exon->tName));
 	gene->tSeq = exon->tSeq;
 	gene->qStart = exon->qStart;
 	gene->qEnd = exon->qEnd;
@@ -599,7 +614,6 @@ static struct gfRange *seqClumpToRangeList(struct gfClump *clumpList, int frame)
 {
 struct gfRange *rangeList = NULL, *range;
 struct gfClump *clump;
-char *name;
 int tOff;
 
 for (clump = clumpList; clump != NULL; clump = clump->next)
@@ -608,8 +622,8 @@ for (clump = clumpList; clump != NULL; clump = clump->next)
     AllocVar(range);
     range->qStart = clump->qStart;
     range->qEnd = clump->qEnd;
-    name = clumpTargetName(clump);
-    range->tName = cloneString(name);
+    range->tName = clumpTargetName(clump);
+    range->tId = clump->target->id;
     range->tStart = clump->tStart - tOff;
     range->tEnd = clump->tEnd - tOff;
     range->tSeq = clump->target->seq;
@@ -783,7 +797,8 @@ for (hit = clump->hitList; ; hit = hit->next)
 		    AllocVar(range);
 		    range->qStart = qs - qSeq->dna;
 		    range->qEnd = qe - qSeq->dna;
-		    range->tName = cloneString(tSeq->name);
+		    range->tName = tSeq->name;
+		    range->tId = target->id;
 		    range->tSeq = tSeq;
 		    range->tStart = ts - tSeq->dna;
 		    range->tEnd = te - tSeq->dna;
@@ -944,8 +959,10 @@ struct ssBundle *bun;
 int tileSize = gfs[0]->tileSize;
 struct trans3 *t3;
 int hitCount;
-struct lm *lm = lmInit(0);
+struct lm *lm = gfWorkspaceForThread()->lm;
 
+lmReset(lm);
+lmTrim(lm, gfWorkspaceSpareMax);
 gfTransFindClumps(gfs, qSeq, clumps, lm, &hitCount);
 for (frame=0; frame<3; ++frame)
     {
@@ -975,7 +992,6 @@ for (range = rangeList; range != NULL; range = range->next)
 gfRangeFreeList(&rangeList);
 for (frame=0; frame<3; ++frame)
     gfClumpFreeList(&clumps[frame]);
-lmCleanup(&lm);
 }
 
 void rangeCoorTimes3(struct gfRange *rangeList)
@@ -1276,9 +1292,11 @@ int tileSize = gfs[0]->tileSize;
 bioSeq *targetSeq;
 struct ssBundle *bun, *bunList = NULL;
 int hitCount;
-struct lm *lm = lmInit(0);
+struct lm *lm = gfWorkspaceForThread()->lm;
 enum ffStringency stringency = (isRna ? ffCdna : ffLoose);
 
+lmReset(lm);
+lmTrim(lm, gfWorkspaceSpareMax);
 gfTransTransFindClumps(gfs, qTrans->trans, clumps, lm, &hitCount);
 for (qFrame = 0; qFrame<3; ++qFrame)
     {
@@ -1310,7 +1328,6 @@ for (qFrame = 0; qFrame<3; ++qFrame)
 	gfClumpFreeList(&clumps[qFrame][tFrame]);
 gfRangeFreeList(&rangeList);
 trans3Free(&qTrans);
-lmCleanup(&lm);
 slReverse(&bunList);
 return bunList;
 }
@@ -1470,6 +1487,86 @@ static void gfAlignSomeClumps(struct genoFind *gf,  struct gfClump *clumpList,
     bioSeq *seq, boolean isRc,  int minMatch, 
     struct gfOutput *out, boolean isProt, enum ffStringency stringency);
 
+void gfSetBestN(int n)
+/* Have gfLongDnaInMem extend only clumps of hits that cover as much of the
+ * query as the n best clumps found for the query so far, rather than
+ * every clump.  Zero (the default) extends every clump.  The best clumps
+ * are kept over both strands, starting afresh with the forward strand, so
+ * search that one first.  Queries long enough to be searched in pieces
+ * keep best clumps for each piece on its own, so that one piece of an
+ * alignment can't crowd out the rest of it. */
+{
+if (n < 0)
+    errAbort("Number of best clumps can't be negative");
+bestN = n;
+}
+
+static int bestCoverageCmp(const void *va, const void *vb)
+/* Compare coverages so that the least is on top of heap. */
+{
+const int *a = va, *b = vb;
+return *b - *a;
+}
+
+static void resetBestClumps(struct gfWorkspace *ws)
+/* Forget best clumps of last query. */
+{
+struct quickHeap *h = ws->bestHeap;
+if (h == NULL)
+    {
+    ws->bestHeap = newQuickHeap(bestN, bestCoverageCmp);
+    AllocArray(ws->bestCoverage, bestN);
+    }
+else
+    {
+    while (!quickHeapEmpty(h))
+	removeQuickHeapTop(h);
+    }
+}
+
+static struct gfClump *keepBestClumps(struct gfWorkspace *ws, 
+	struct gfClump *clumpList)
+/* Return clumps that cover at least as much of the query as the bestN'th
+ * best clump of query seen so far, on either strand, and free the rest.
+ * The clumps come sorted by queryCoverage, best first, so once one falls
+ * short so do the rest. */
+{
+struct quickHeap *h;
+struct gfClump *clump, *next, *keptList = NULL;
+
+if (ws->bestHeap == NULL)
+    resetBestClumps(ws);
+h = ws->bestHeap;
+for (clump = clumpList; clump != NULL; clump = next)
+    {
+    int coverage = clump->queryCoverage;
+    next = clump->next;
+    if (h->heapCount < bestN)
+	{
+	int *slot = &ws->bestCoverage[h->heapCount];
+	*slot = coverage;
+	addToQuickHeap(h, slot);
+	}
+    else
+	{
+	int *least = peekQuickHeapTop(h);
+	if (coverage < *least)
+	    {
+	    gfClumpFreeList(&clump);
+	    break;
+	    }
+	if (coverage > *least)
+	    {
+	    *least = coverage;
+	    quickHeapTopChanged(h);
+	    }
+	}
+    slAddHead(&keptList, clump);
+    }
+slReverse(&keptList);
+return keptList;
+}
+
 void gfLongDnaInMem(struct dnaSeq *query, struct genoFind *gf, 
    boolean isRc, int minScore, Bits *qMaskBits, 
    struct gfOutput *out, boolean fastMap, boolean band)
@@ -1481,11 +1578,14 @@ int maxSize = MAXSINGLEPIECESIZE;
 int preferredSize = 4500;
 int overlapSize = 250;
 struct dnaSeq subQuery = *query;
-struct lm *lm = lmInit(0);
+struct gfWorkspace *ws = gfWorkspaceForThread();
+struct lm *lm = ws->lm;
 int subOffset, subSize, nextOffset;
 DNA saveEnd, *endPos;
 struct ssBundle *oneBunList = NULL, *bigBunList = NULL, *bun;
-struct hash *bunHash = newHash(8);
+struct hash *bunHash = ws->bunHash;
+
+gfWorkspaceReset(ws);
 
 for (subOffset = 0; subOffset<query->size; subOffset = nextOffset)
     {
@@ -1523,6 +1623,12 @@ for (subOffset = 0; subOffset<query->size; subOffset = nextOffset)
     else
 	{
 	clumpList = gfFindClumpsWithQmask(gf, &subQuery, qMaskBits, subOffset, lm, &hitCount);
+	if (bestN > 0)
+	    {
+	    if (query->size > maxSize || !isRc)
+		resetBestClumps(ws);
+	    clumpList = keepBestClumps(ws, clumpList);
+	    }
 	if (fastMap)
 	    {
 	    oneBunList = fastMapClumpsToBundles(gf, clumpList, &subQuery);
@@ -1549,10 +1655,94 @@ for (bun = bigBunList; bun != NULL; bun = bun->next)
 	bun, NULL, isRc, FALSE, ffCdna, minScore, out);
     }
 ssBundleFreeList(&bigBunList);
-freeHash(&bunHash);
-lmCleanup(&lm);
 }
 
+static void alignOnePieceStrand(struct genoFind *gf, struct dnaSeq *seq, 
+	boolean isRc, struct gfClump *clumpList, int minScore,
+	struct gfOutput *out, boolean fastMap, struct gfWorkspace *ws)
+/* Align clumps of one strand of a query small enough to be done in one
+ * piece, as gfLongDnaInMem does, and save alignments.  Frees clumpList. */
+{
+struct ssBundle *oneBunList = NULL, *bigBunList = NULL, *bun;
+struct gfRange *rangeList = NULL;
+DNA *endPos = &seq->dna[seq->size];
+DNA saveEnd = *endPos;
+
+hashClear(ws->bunHash);
+if (bestN > 0)
+    {
+    if (!isRc)
+	resetBestClumps(ws);
+    clumpList = keepBestClumps(ws, clumpList);
+    }
+*endPos = 0;
+if (fastMap)
+    oneBunList = fastMapClumpsToBundles(gf, clumpList, seq);
+else
+    {
+    oneBunList = gfClumpsToBundles(clumpList, isRc, seq, minScore, &rangeList);
+    gfRangeFreeList(&rangeList);
+    }
+gfClumpFreeList(&clumpList);
+addToBigBundleList(&oneBunList, ws->bunHash, &bigBunList, seq);
+*endPos = saveEnd;
+for (bun = bigBunList; bun != NULL; bun = bun->next)
+    {
+    ssStitch(bun, ffCdna, minScore, ssAliCount);
+    if (!fastMap)
+	refineSmallExonsInBundle(bun);
+    saveAlignments(bun->genoSeq->name, bun->genoSeq->size, 0, 
+	bun, NULL, isRc, FALSE, ffCdna, minScore, out);
+    }
+ssBundleFreeList(&bigBunList);
+}
+
+void gfShortDnaBatchInMem(struct dnaSeq **queries, Bits **qMaskBits,
+	int queryCount, struct genoFind *gf, int minScore, 
+	struct gfOutput *out, FILE *f, boolean fastMap)
+/* Align a batch of queries, each no bigger than MAXSINGLEPIECESIZE, on
+ * both strands, with the same results as gfLongDnaInMem on each strand
+ * of each in turn.  Each query is finished with gfOutputQuery(out, f)
+ * once both its strands are done.  The tiles of the whole batch are
+ * looked up together, and the memory for it all comes from one arena.
+ * qMaskBits may be NULL, or have NULL for queries that aren't masked. */
+{
+struct gfWorkspace *ws = gfWorkspaceForThread();
+struct lm *lm = ws->lm;
+int seqCount = 2*queryCount;
+struct dnaSeq **seqs;
+Bits **masks;
+struct gfClump **clumps;
+int i;
+
+gfWorkspaceReset(ws);
+lmAllocArray(lm, seqs, seqCount);
+lmAllocArray(lm, masks, seqCount);
+lmAllocArray(lm, clumps, seqCount);
+for (i=0; i<queryCount; ++i)
+    {
+    struct dnaSeq *query = queries[i], *rc;
+    Bits *mask = (qMaskBits == NULL ? NULL : qMaskBits[i]);
+    if (query->size > MAXSINGLEPIECESIZE)
+	errAbort("Query %s of size %d is too big to align in a batch", 
+		query->name, query->size);
+    lmAllocVar(lm, rc);
+    *rc = *query;
+    rc->dna = lmAlloc(lm, query->size + 1);
+    memcpy(rc->dna, query->dna, query->size);
+    reverseComplement(rc->dna, rc->size);
+    seqs[2*i] = query;
+    seqs[2*i+1] = rc;
+    masks[2*i] = masks[2*i+1] = mask;
+    }
+gfFindClumpsBatch(gf, seqs, masks, seqCount, lm, clumps);
+for (i=0; i<queryCount; ++i)
+    {
+    alignOnePieceStrand(gf, seqs[2*i], FALSE, clumps[2*i], minScore, out, fastMap, ws);
+    alignOnePieceStrand(gf, seqs[2*i+1], TRUE, clumps[2*i+1], minScore, out, fastMap, ws);
+    gfOutputQuery(out, f);
+    }
+}
 
 void gfLongTransTransInMem(struct dnaSeq *query, struct genoFind *gfs[3], 
    struct hash *t3Hash, boolean qIsRc, boolean tIsRc, boolean qIsRna,
@@ -1568,8 +1758,9 @@ struct dnaSeq subQuery = *query;
 int subOffset, subSize, nextOffset;
 DNA saveEnd, *endPos;
 struct ssBundle *oneBunList = NULL, *bigBunList = NULL, *bun;
-struct hash *bunHash = newHash(8);
+struct hash *bunHash = gfWorkspaceForThread()->bunHash;
 
+hashClear(bunHash);
 for (subOffset = 0; subOffset<query->size; subOffset = nextOffset)
     {
     /* Figure out size of this piece.  If query is
@@ -1606,7 +1797,6 @@ for (bun = bigBunList; bun != NULL; bun = bun->next)
     saveAlignments(bun->genoSeq->name, bun->genoSeq->size, 0, 
 	bun, NULL, qIsRc, tIsRc, stringency, minScore, out);
     }
-hashFree(&bunHash);
 ssBundleFreeList(&bigBunList);
 }
 
@@ -9,7 +9,8 @@ struct gfRange
     struct gfRange *next;  /* Next in singly linked list. */
     int qStart;	/* Start in query */
     int qEnd;	/* End in query */
-    char *tName;	  /* Target name.  Allocated here. */
+    char *tName;	  /* Target name.  Allocated here unless tId is set. */
+    int tId;		  /* Id of target gfSeqSource, or 0 if not known. */
     struct dnaSeq *tSeq;  /* Target Seq. May be NULL in a .nib.  Not allocated here. */
     int tStart;	/* Start in target */
     int tEnd;	/* End in target */
@@ -12,6 +12,7 @@
 #include "maf.h"
 #include "trans3.h"
 #include "psl.h"
+#include "pslBin.h"
 #include "genoFind.h"
 
 
@@ -20,12 +21,20 @@ struct pslxData
     {
     FILE *f;			/* Output file. */
     boolean saveSeq;		/* Save sequence too? */
+    struct pslBinOut *binOut;	/* State of pslBin output, NULL for text. */
+    boolean binTextHead;	/* Psl header wanted when pslBin is converted. */
     };
 
 struct axtData
 /* This is the data structure put in gfOutput.data for axt/blast output. */
     {
     struct axtBundle *bundleList;	/* List of bundles. */
+    FILE *f;			/* Output file. */
+    void (*bundleOut)(struct gfOutput *out, struct axtBundle *gab, FILE *f);
+    	/* If non-NULL bundles are written with this as they are made
+	 * rather than saved up for the end of the query. */
+    size_t bufferSize;		/* Bytes of alignment text in bundleList. */
+    size_t bufferMax;		/* Write bundleList early past this, 0 for never. */
     char *databaseName;		/* Just used for blast. */
     int databaseSeqCount;	/* Just used for blast. */
     double databaseLetters; /* Just used for blast. */
@@ -33,14 +42,197 @@ struct axtData
     double minIdentity; /* Just used for blast. */
     };
 
+#define axtBufferMax (64*1024*1024)	/* Default bufferMax for axt and maf. */
+
+#if defined(__GNUC__)
+#define popCount64(x) __builtin_popcountll(x)
+#else
+static int popCount64(bits64 x)
+/* Return number of bits set in x. */
+{
+int count = 0;
+for (; x != 0; x &= x - 1)
+    ++count;
+return count;
+}
+#endif
+
+static bits64 spreadMaskByte[256];
+/* For each byte of mask bits, a word with the high bit set in the bytes
+ * of sequence the set bits are for.  The first bit (0x80) goes with the
+ * first base in memory. */
+
+static void initSpreadMaskByte()
+/* Fill in spreadMaskByte. */
+{
+static boolean initted = FALSE;
+UBYTE lanes[8];
+int b, j;
+if (initted)
+    return;
+for (b=0; b<256; ++b)
+    {
+    for (j=0; j<8; ++j)
+	lanes[j] = ((b & (0x80>>j)) ? 0x80 : 0);
+    memcpy(&spreadMaskByte[b], lanes, sizeof(lanes));
+    }
+initted = TRUE;
+}
+
+static bits64 zeroByteBits(bits64 x)
+/* Return word with high bit set in each byte of x that is zero. */
+{
+bits64 low7 = 0x7f7f7f7f7f7f7f7fULL;
+return ~(((x & low7) + low7) | x | low7);
+}
+
+static UBYTE maskByteAt(Bits *b, int bitIx)
+/* Return the eight bits of b starting at bitIx, first one highest. */
+{
+int byteIx = (bitIx>>3), shift = (bitIx&7);
+if (shift == 0)
+    return b[byteIx];
+return (UBYTE)((b[byteIx] << shift) | (b[byteIx+1] >> (8 - shift)));
+}
+
+static void countBlock(DNA *np, DNA *hp, int size, Bits *maskBits, int maskOff,
+	int *pMatch, int *pMismatch, int *pRepMatch, int *pNs)
+/* Add matches, mismatches, matches in masked target and N's in a block
+ * to counts.  Eight bases are compared at a time as the bytes of a word,
+ * and the masked matches are found by anding with the mask bits spread
+ * out to line up with those bytes. */
+{
+bits64 nBytes = 0x6e6e6e6e6e6e6e6eULL;	/* 'n' in each byte. */
+int match = 0, mismatch = 0, repMatch = 0, ns = 0;
+int i;
+
+for (i=0; i + 8 <= size; i += 8)
+    {
+    bits64 n, h, isN, same;
+    memcpy(&n, np+i, sizeof(n));
+    memcpy(&h, hp+i, sizeof(h));
+    isN = zeroByteBits(n ^ nBytes) | zeroByteBits(h ^ nBytes);
+    same = zeroByteBits(n ^ h) & ~isN;
+    ns += popCount64(isN);
+    mismatch += 8 - popCount64(isN | same);
+    if (maskBits != NULL)
+	{
+	bits64 rep = same & spreadMaskByte[maskByteAt(maskBits, maskOff+i)];
+	repMatch += popCount64(rep);
+	match += popCount64(same ^ rep);
+	}
+    else
+	match += popCount64(same);
+    }
+for (; i<size; ++i)
+    {
+    DNA n = np[i], h = hp[i];
+    if (n == 'n' || h == 'n')
+	++ns;
+    else if (n != h)
+	++mismatch;
+    else if (maskBits != NULL && bitReadOne(maskBits, maskOff+i))
+	++repMatch;
+    else
+	++match;
+    }
+*pMatch += match;
+*pMismatch += mismatch;
+*pRepMatch += repMatch;
+*pNs += ns;
+}
+
+static char digitPairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+/* Two digit decimal numbers from 00 to 99 one after the other. */
+
+static void appendNum(struct dyString *dy, long x, char sep)
+/* Append x to dy as %ld would print it, followed by sep.  Digits are
+ * made two at a time from the end back. */
+{
+char buf[32];
+char *end = buf + sizeof(buf), *s = end;
+unsigned long u = (x < 0 ? 0 - (unsigned long)x : (unsigned long)x);
+*--s = sep;
+while (u >= 100)
+    {
+    int pair = (u % 100) * 2;
+    u /= 100;
+    *--s = digitPairs[pair+1];
+    *--s = digitPairs[pair];
+    }
+if (u >= 10)
+    {
+    *--s = digitPairs[u*2+1];
+    *--s = digitPairs[u*2];
+    }
+else
+    *--s = '0' + u;
+if (x < 0)
+    *--s = '-';
+dyStringAppendN(dy, s, end - s);
+}
+
+static void savePslBin(struct pslBinOut *binOut, FILE *f, struct ffAli *ali,
+	DNA *needle, struct dnaSeq *tSeq, struct trans3 *t3List, int chromOffset,
+	int matchCount, int mismatchCount, int repMatch, int countNs,
+	int nInsertCount, int nInsertBaseCount, int hInsertCount, int hInsertBaseCount,
+	boolean isRc, boolean reportTargetStrand, boolean targetIsRc,
+	struct dnaSeq *qSeq, int nStart, int nEnd,
+	char *chromName, int chromSize, int hStart, int hEnd)
+/* Write alignment that savePslx has worked out in pslBin format. */
+{
+struct psl psl;
+struct ffAli *ff;
+int i;
+
+ZeroVar(&psl);
+psl.match = matchCount;
+psl.misMatch = mismatchCount;
+psl.repMatch = repMatch;
+psl.nCount = countNs;
+psl.qNumInsert = nInsertCount;
+psl.qBaseInsert = nInsertBaseCount;
+psl.tNumInsert = hInsertCount;
+psl.tBaseInsert = hInsertBaseCount;
+psl.strand[0] = (isRc ? '-' : '+');
+if (reportTargetStrand)
+    psl.strand[1] = (targetIsRc ? '-' : '+');
+psl.qName = qSeq->name;
+psl.qSize = qSeq->size;
+psl.qStart = nStart;
+psl.qEnd = nEnd;
+psl.tName = chromName;
+psl.tSize = chromSize;
+psl.tStart = hStart;
+psl.tEnd = hEnd;
+psl.blockCount = ffAliCount(ali);
+AllocArray(psl.blockSizes, psl.blockCount);
+AllocArray(psl.qStarts, psl.blockCount);
+AllocArray(psl.tStarts, psl.blockCount);
+for (ff = ali, i = 0; ff != NULL; ff = ff->right, ++i)
+    {
+    psl.blockSizes[i] = ff->nEnd - ff->nStart;
+    psl.qStarts[i] = ff->nStart - needle;
+    psl.tStarts[i] = trans3GenoPos(ff->hStart, tSeq, t3List, FALSE) + chromOffset;
+    }
+pslBinWrite(binOut, &psl, f);
+freeMem(psl.blockSizes);
+freeMem(psl.qStarts);
+freeMem(psl.tStarts);
+}
+
 static void savePslx(char *chromName, int chromSize, int chromOffset,
 	struct ffAli *ali, struct dnaSeq *tSeq, struct dnaSeq *qSeq, 
 	boolean isRc, enum ffStringency stringency, int minMatch, FILE *f,
 	struct hash *t3Hash, boolean reportTargetStrand, boolean targetIsRc,
 	struct hash *maskHash, int minIdentity, 
-	boolean qIsProt, boolean tIsProt, boolean saveSeq)
+	boolean qIsProt, boolean tIsProt, boolean saveSeq,
+	struct pslBinOut *binOut)
 /* Analyse one alignment and if it looks good enough write it out to file in
- * psl format (or pslX format - if saveSeq is TRUE).  */
+ * psl format (or pslX format - if saveSeq is TRUE, or pslBin format if
+ * binOut is non-NULL).  */
 {
 /* This function was stolen from psLayout and slightly extensively to cope
  * with protein as well as DNA aligments. */
@@ -59,14 +251,18 @@ int matchCount = 0;
 int mismatchCount = 0;
 int repMatch = 0;
 int countNs = 0;
-DNA *np, *hp, n, h;
+DNA *np, *hp;
 int blockSize;
-int i;
 struct trans3 *t3List = NULL;
 Bits *maskBits = NULL;
 
 if (maskHash != NULL)
-    maskBits = hashMustFindVal(maskHash, tSeq->name);
+    {
+    /* Use mask attached to target if there is one, saving a lookup. */
+    maskBits = tSeq->mask;
+    if (maskBits == NULL)
+	maskBits = hashMustFindVal(maskHash, tSeq->name);
+    }
 if (t3Hash != NULL)
     t3List = hashMustFindVal(t3Hash, tSeq->name);
 hStart = trans3GenoPos(ali->hStart, tSeq, t3List, FALSE) + chromOffset;
@@ -79,31 +275,8 @@ for (ff = ali; ff != NULL; ff = nextFf)
     blockSize = ff->nEnd - ff->nStart;
     np = ff->nStart;
     hp = ff->hStart;
-    for (i=0; i<blockSize; ++i)
-	{
-	n = np[i];
-	h = hp[i];
-	if (n == 'n' || h == 'n')
-	    ++countNs;
-	else
-	    {
-	    if (n == h)
-		{
-		if (maskBits != NULL)
-		    {
-		    int seqOff = hp + i - hay;
-		    if (bitReadOne(maskBits, seqOff))
-		        ++repMatch;
-		    else
-		        ++matchCount;
-		    }
-		else
-		    ++matchCount;
-		}
-	    else
-		++mismatchCount;
-	    }
-	}
+    countBlock(np, hp, blockSize, maskBits, hp - hay,
+	&matchCount, &mismatchCount, &repMatch, &countNs);
     if (nextFf != NULL)
 	{
 	int nhStart = trans3GenoPos(nextFf->hStart, tSeq, t3List, FALSE) + chromOffset;
@@ -149,40 +322,66 @@ for (ff = ali; ff != NULL; ff = nextFf)
 		hStart = chromSize - hEnd;
 		hEnd = chromSize - temp;
 		}
-	    fprintf(f, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%c",
-		matchCount, mismatchCount, repMatch, countNs, nInsertCount, nInsertBaseCount, hInsertCount, hInsertBaseCount,
-		(isRc ? '-' : '+'));
+	    if (binOut != NULL)
+		{
+		savePslBin(binOut, f, ali, needle, tSeq, t3List, chromOffset,
+		    matchCount, mismatchCount, repMatch, countNs,
+		    nInsertCount, nInsertBaseCount, hInsertCount, hInsertBaseCount,
+		    isRc, reportTargetStrand, targetIsRc, qSeq, nStart, nEnd,
+		    chromName, chromSize, hStart, hEnd);
+		return;
+		}
+	    /* Put line together in thread's buffer and write it in one go. */
+	    struct dyString *line = gfWorkspaceForThread()->outLine;
+	    dyStringClear(line);
+	    appendNum(line, matchCount, '\t');
+	    appendNum(line, mismatchCount, '\t');
+	    appendNum(line, repMatch, '\t');
+	    appendNum(line, countNs, '\t');
+	    appendNum(line, nInsertCount, '\t');
+	    appendNum(line, nInsertBaseCount, '\t');
+	    appendNum(line, hInsertCount, '\t');
+	    appendNum(line, hInsertBaseCount, '\t');
+	    dyStringAppendC(line, (isRc ? '-' : '+'));
 	    if (reportTargetStrand)
-		fprintf(f, "%c", (targetIsRc ? '-' : '+') );
-	    fprintf(f, "\t%s\t%d\t%d\t%d\t"
-			 "%s\t%d\t%d\t%d\t%d\t",
-		qSeq->name, qSeq->size, nStart, nEnd,
-		chromName, chromSize, hStart, hEnd,
-		ffAliCount(ali));
+		dyStringAppendC(line, (targetIsRc ? '-' : '+') );
+	    dyStringAppendC(line, '\t');
+	    dyStringAppend(line, qSeq->name);
+	    dyStringAppendC(line, '\t');
+	    appendNum(line, qSeq->size, '\t');
+	    appendNum(line, nStart, '\t');
+	    appendNum(line, nEnd, '\t');
+	    dyStringAppend(line, chromName);
+	    dyStringAppendC(line, '\t');
+	    appendNum(line, chromSize, '\t');
+	    appendNum(line, hStart, '\t');
+	    appendNum(line, hEnd, '\t');
+	    appendNum(line, ffAliCount(ali), '\t');
 	    for (ff = ali; ff != NULL; ff = ff->right)
-		fprintf(f, "%ld,", (long)(ff->nEnd - ff->nStart));
-	    fprintf(f, "\t");
+		appendNum(line, ff->nEnd - ff->nStart, ',');
+	    dyStringAppendC(line, '\t');
 	    for (ff = ali; ff != NULL; ff = ff->right)
-		fprintf(f, "%ld,", (long)(ff->nStart - needle));
-	    fprintf(f, "\t");
+		appendNum(line, ff->nStart - needle, ',');
+	    dyStringAppendC(line, '\t');
 	    for (ff = ali; ff != NULL; ff = ff->right)
-		fprintf(f, "%d,", trans3GenoPos(ff->hStart, tSeq, t3List, FALSE) + chromOffset);
+		appendNum(line, trans3GenoPos(ff->hStart, tSeq, t3List, FALSE) + chromOffset, ',');
 	    if (saveSeq)
 		{
-		fputc('\t', f);
+		dyStringAppendC(line, '\t');
 		for (ff = ali; ff != NULL; ff = ff->right)
 		    {
-		    mustWrite(f, ff->nStart, ff->nEnd - ff->nStart);
-		    fputc(',', f);
+		    dyStringAppendN(line, ff->nStart, ff->nEnd - ff->nStart);
+		    dyStringAppendC(line, ',');
 		    }
-		fputc('\t', f);
+		dyStringAppendC(line, '\t');
 		for (ff = ali; ff != NULL; ff = ff->right)
 		    {
-		    mustWrite(f, ff->hStart, ff->hEnd - ff->hStart);
-		    fputc(',', f);
+		    dyStringAppendN(line, ff->hStart, ff->hEnd - ff->hStart);
+		    dyStringAppendC(line, ',');
 		    }
 		}
-	    fprintf(f, "\n");
+	    dyStringAppendC(line, '\n');
+	    mustWrite(f, line->string, line->stringSize);
 	    if (ferror(f))
 		{
 		perror("");
@@ -205,7 +404,7 @@ savePslx(chromName, chromSize, chromOffset, ali, tSeq, qSeq,
     qIsRc, stringency, minMatch, outForm->f, t3Hash, 
     out->reportTargetStrand, tIsRc,
     out->maskHash, out->minGood, 
-    out->qIsProt, out->tIsProt, outForm->saveSeq);
+    out->qIsProt, out->tIsProt, outForm->saveSeq, outForm->binOut);
 }
 
 static struct ffAli *ffNextBreak(struct ffAli *ff, int maxInsert, 
@@ -251,6 +450,7 @@ struct axt *axt;
 struct dyString *q = newDyString(1024), *t = newDyString(1024);
 struct axtBundle *gab;
 struct trans3 *t3List = NULL;
+size_t textSize = 0;
 
 if (t3Hash != NULL)
     t3List = hashMustFindVal(t3Hash, tSeq->name);
@@ -312,11 +512,33 @@ for (sAli = ali; sAli != NULL; sAli = eAli)
     else 
 	axt->score = axtScoreDnaDefault(axt);
     slAddHead(&gab->axtList, axt);
+    textSize += 2*axt->symCount;
     }
 slReverse(&gab->axtList);
 dyStringFree(&q);
 dyStringFree(&t);
-slAddHead(&ad->bundleList, gab);
+if (ad->bundleOut != NULL)
+    {
+    ad->bundleOut(out, gab, ad->f);
+    axtBundleFree(&gab);
+    }
+else
+    {
+    slAddHead(&ad->bundleList, gab);
+    /* A query with a great many alignments is written in pieces rather
+     * than held in memory all at once. */
+    ad->bufferSize += textSize;
+    if (ad->bufferMax > 0 && ad->bufferSize > ad->bufferMax && ad->f != NULL)
+	out->queryOut(out, ad->f);
+    }
+}
+
+static void axtBundleOut(struct gfOutput *out, struct axtBundle *gab, FILE *f)
+/* Write out one bundle in axt format. */
+{
+struct axt *axt;
+for (axt = gab->axtList; axt != NULL; axt = axt->next)
+    axtWrite(axt, f);
 }
 
 static void axtQueryOut(struct gfOutput *out, FILE *f)
@@ -325,12 +547,9 @@ static void axtQueryOut(struct gfOutput *out, FILE *f)
 struct axtData *aod = out->data;
 struct axtBundle *gab;
 for (gab = aod->bundleList; gab != NULL; gab = gab->next)
-    {
-    struct axt *axt;
-    for (axt = gab->axtList; axt != NULL; axt = axt->next)
-	axtWrite(axt, f);
-    }
+    axtBundleOut(out, gab, f);
 axtBundleFreeList(&aod->bundleList);
+aod->bufferSize = 0;
 }
 
 static void mafHead(struct gfOutput *out, FILE *f)
@@ -339,22 +558,48 @@ static void mafHead(struct gfOutput *out, FILE *f)
 mafWriteStart(f, "blastz");
 }
 
+static void mafBundleOut(struct gfOutput *out, struct axtBundle *gab, FILE *f)
+/* Write out one bundle in maf format.  The maf is put together here rather
+ * than with mafFromAxtTemp, whose components are static and so shared by
+ * all threads. */
+{
+struct axt *axt;
+for (axt = gab->axtList; axt != NULL; axt = axt->next)
+    {
+    struct mafAli temp;
+    struct mafComp qComp, tComp;
+    ZeroVar(&temp);
+    ZeroVar(&qComp);
+    ZeroVar(&tComp);
+    temp.score = axt->score;
+    temp.textSize = axt->symCount;
+    qComp.src = axt->qName;
+    qComp.srcSize = gab->qSize;
+    qComp.strand = axt->qStrand;
+    qComp.start = axt->qStart;
+    qComp.size = axt->qEnd - axt->qStart;
+    qComp.text = axt->qSym;
+    tComp.src = axt->tName;
+    tComp.srcSize = gab->tSize;
+    tComp.strand = axt->tStrand;
+    tComp.start = axt->tStart;
+    tComp.size = axt->tEnd - axt->tStart;
+    tComp.text = axt->tSym;
+    tComp.next = &qComp;
+    temp.components = &tComp;
+    mafWrite(f, &temp);
+    }
+}
+
 static void mafQueryOut(struct gfOutput *out, FILE *f)
 /* Do axt oriented output - at end of processing query. */
 {
 struct axtData *aod = out->data;
 struct axtBundle *gab;
 for (gab = aod->bundleList; gab != NULL; gab = gab->next)
-    {
-    struct axt *axt;
-    for (axt = gab->axtList; axt != NULL; axt = axt->next)
-	{
-	struct mafAli temp;
-	mafFromAxtTemp(axt, gab->tSize, gab->qSize, &temp);
-	mafWrite(f, &temp);
-	}
-    }
+    mafBundleOut(out, gab, f);
 axtBundleFreeList(&aod->bundleList);
+aod->bufferSize = 0;
 }
 
 static int axtMatchCount(struct axt *axt)
@@ -390,38 +635,43 @@ for (; axt != NULL; axt = axt->next)
 return (double)matchCount/(double)symCount;
 }
 
+static void sim4BundleOut(struct gfOutput *out, struct axtBundle *gab, FILE *f)
+/* Write out one bundle in sim4-like format. */
+{
+struct axt *axt = gab->axtList;
+// check minIdentity of the entire alignment
+int goodPpt = 1000 * axtListRatio(axt);
+if (!(goodPpt >= out->minGood))
+    return; 
+fprintf(f, "\n");
+fprintf(f, "seq1 = %s, %d bp\n", axt->qName, gab->qSize);
+fprintf(f, "seq2 = %s, %d bp\n", axt->tName, gab->tSize);
+fprintf(f, "\n");
+if (axt->qStrand == '-')
+    fprintf(f, "(complement)\n");
+for (; axt != NULL; axt = axt->next)
+    {
+    fprintf(f, "%d-%d  ", axt->qStart+1, axt->qEnd);
+    fprintf(f, "(%d-%d)   ", axt->tStart+1, axt->tEnd);
+    fprintf(f, "%1.0f%% ", 100.0 * axtIdRatio(axt));
+    if (axt->qStrand == '-')
+	 fprintf(f, "<-\n");
+    else
+	 fprintf(f, "->\n");
+    }
+}
+
 static void sim4QueryOut(struct gfOutput *out, FILE *f)
-/* Do sim4-like output - at end of processing query. */
+/* Do sim4-like output - at end of processing query.  This is only needed
+ * if there is no file to write bundles to as they are made. */
 {
 struct axtData *aod = out->data;
 struct axtBundle *gab;
 slReverse(&aod->bundleList);
-
 for (gab = aod->bundleList; gab != NULL; gab = gab->next)
-    {
-    struct axt *axt = gab->axtList;
-    // check minIdentity of the entire alignment
-    int goodPpt = 1000 * axtListRatio(axt);
-    if (!(goodPpt >= out->minGood))
-	continue; 
-    fprintf(f, "\n");
-    fprintf(f, "seq1 = %s, %d bp\n", axt->qName, gab->qSize);
-    fprintf(f, "seq2 = %s, %d bp\n", axt->tName, gab->tSize);
-    fprintf(f, "\n");
-    if (axt->qStrand == '-')
-	fprintf(f, "(complement)\n");
-    for (; axt != NULL; axt = axt->next)
-	{
-	fprintf(f, "%d-%d  ", axt->qStart+1, axt->qEnd);
-	fprintf(f, "(%d-%d)   ", axt->tStart+1, axt->tEnd);
-	fprintf(f, "%1.0f%% ", 100.0 * axtIdRatio(axt));
-	if (axt->qStrand == '-')
-	     fprintf(f, "<-\n");
-	else
-	     fprintf(f, "->\n");
-	}
-    }
+    sim4BundleOut(out, gab, f);
 axtBundleFreeList(&aod->bundleList);
+aod->bufferSize = 0;
 }
 
 static void blastQueryOut(struct gfOutput *out, FILE *f)
@@ -432,6 +682,7 @@ axtBlastOut(aod->bundleList, out->queryIx, out->qIsProt, f,
 	aod->databaseName, aod->databaseSeqCount, aod->databaseLetters,
 	aod->blastType, "blat", aod->minIdentity);
 axtBundleFreeList(&aod->bundleList);
+aod->bufferSize = 0;
 }
 
 static struct gfOutput *gfOutputInit(int goodPpt, boolean qIsProt, boolean tIsProt)
@@ -461,6 +712,7 @@ struct gfOutput *gfOutputPsl(int goodPpt,
 struct gfOutput *out = gfOutputInit(goodPpt, qIsProt, tIsProt);
 struct pslxData *pslData;
 
+initSpreadMaskByte();
 AllocVar(pslData);
 pslData->saveSeq = saveSeq;
 pslData->f = f;
@@ -488,6 +740,9 @@ struct gfOutput *gfOutputAxt(int goodPpt, boolean qIsProt,
 /* Setup output for axt format. */
 {
 struct gfOutput *out = gfOutputAxtMem(goodPpt, qIsProt, tIsProt);
+struct axtData *ad = out->data;
+ad->f = f;
+ad->bufferMax = axtBufferMax;
 out->queryOut = axtQueryOut;
 return out;
 }
@@ -497,6 +752,9 @@ struct gfOutput *gfOutputMaf(int goodPpt, boolean qIsProt,
 /* Setup output for maf format. */
 {
 struct gfOutput *out = gfOutputAxtMem(goodPpt, qIsProt, tIsProt);
+struct axtData *ad = out->data;
+ad->f = f;
+ad->bufferMax = axtBufferMax;
 out->queryOut = mafQueryOut;
 out->fileHead = mafHead;
 return out;
@@ -528,10 +786,31 @@ ad->databaseSeqCount = databaseSeqCount;
 ad->databaseLetters = databaseLetters;
 ad->blastType = blastType;
 ad->minIdentity = minIdentity;
+ad->f = f;
 out->queryOut = blastQueryOut;
 return out;
 }
 
+static void pslBinHead(struct gfOutput *out, FILE *f)
+/* Write out pslBin file header. */
+{
+struct pslxData *pslData = out->data;
+pslBinWriteHead(f, pslData->binTextHead);
+}
+
+struct gfOutput *gfOutputPslBin(int goodPpt, 
+	boolean qIsProt, boolean tIsProt, FILE *f, boolean noHead)
+/* Set up binary psl output.  The file header is always written, noHead
+ * just records whether pslbToPsl should write a psl header. */
+{
+struct gfOutput *out = gfOutputPsl(goodPpt, qIsProt, tIsProt, f, FALSE, TRUE);
+struct pslxData *pslData = out->data;
+pslData->binOut = pslBinOutNew();
+pslData->binTextHead = !noHead;
+out->fileHead = pslBinHead;
+return out;
+}
+
 struct gfOutput *gfOutputAny(char *format, 
 	int goodPpt, boolean qIsProt, boolean tIsProt, 
 	boolean noHead, char *databaseName,
@@ -540,7 +819,7 @@ struct gfOutput *gfOutputAny(char *format,
 	FILE *f)
 /* Initialize output in a variety of formats in file or memory. 
  * Parameters:
- *    format - either 'psl', 'pslx', 'sim4', 'blast', 'wublast', 'axt', 'xml'
+ *    format - either 'psl', 'pslx', 'pslb', 'sim4', 'blast', 'wublast', 'axt', 'xml'
  *    goodPpt - minimum identity of alignments to output in parts per thousand
  *    qIsProt - true if query side is a protein.
  *    tIsProt - true if target (database) side is a protein.
@@ -561,8 +840,19 @@ if (sameWord(format, "psl"))
     out = gfOutputPsl(goodPpt, qIsProt, tIsProt, f, FALSE, noHead);
 else if (sameWord(format, "pslx"))
     out = gfOutputPsl(goodPpt, qIsProt, tIsProt, f, TRUE, noHead);
+else if (sameWord(format, "pslb"))
+    out = gfOutputPslBin(goodPpt, qIsProt, tIsProt, f, noHead);
 else if (sameWord(format, "sim4"))
+    {
+    /* Sim4 output comes in the order alignments are made, so can always
+     * be written as they are made. */
+    struct axtData *ad;
     out = gfOutputSim4(goodPpt, qIsProt, tIsProt, databaseName);
+    ad = out->data;
+    ad->f = f;
+    if (f != NULL)
+	ad->bundleOut = sim4BundleOut;
+    }
 else if (stringArrayIx(format, blastTypes, ArraySize(blastTypes)) >= 0)
     out = gfOutputBlast(goodPpt, qIsProt, tIsProt, 
 	    databaseName, databaseSeqCount, databaseLetters, format, 
@@ -576,6 +866,53 @@ else
 return out;
 }
 
+FILE *gfOutputSetFile(struct gfOutput *out, FILE *f)
+/* Send psl/pslx, axt, maf and sim4 alignments from now on to f, and
+ * return file they went to before.  The blast formats are only written
+ * to the file passed to gfOutputQuery, so this does nothing and returns
+ * NULL for them.  The others need gfOutputQuery to be passed the same
+ * file as set here. */
+{
+FILE *old = NULL;
+if (out->out == pslOut)
+    {
+    struct pslxData *pslData = out->data;
+    old = pslData->f;
+    pslData->f = f;
+    }
+else if (out->out == saveAxtBundle)
+    {
+    struct axtData *ad = out->data;
+    if (ad->bundleOut != NULL || ad->bufferMax > 0)
+	{
+	old = ad->f;
+	ad->f = f;
+	}
+    }
+return old;
+}
+
+boolean gfOutputStream(struct gfOutput *out)
+/* Have axt or maf output written as each alignment is made rather than
+ * at the end of each query.  This saves memory on queries with many
+ * alignments, but changes the order they come out in.  Returns FALSE
+ * for formats that need all alignments of a query before writing. */
+{
+struct axtData *ad;
+if (out->out != saveAxtBundle)
+    return FALSE;
+ad = out->data;
+if (ad->f == NULL)
+    return FALSE;
+if (out->queryOut == axtQueryOut)
+    ad->bundleOut = axtBundleOut;
+else if (out->queryOut == mafQueryOut)
+    ad->bundleOut = mafBundleOut;
+else if (out->queryOut == sim4QueryOut)
+    ad->bundleOut = sim4BundleOut;
+return ad->bundleOut != NULL;
+}
+
 void gfOutputQuery(struct gfOutput *out, FILE *f)
 /* Finish writing out results for a query to file. */
 {
@@ -597,6 +934,11 @@ void gfOutputFree(struct gfOutput **pOut)
 struct gfOutput *out = *pOut;
 if (out != NULL)
     {
+    if (out->out == pslOut)
+        {
+	struct pslxData *pslData = out->data;
+	pslBinOutFree(&pslData->binOut);
+	}
     freeMem(out->data);
     freez(pOut);
     }
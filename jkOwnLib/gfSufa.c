@@ -0,0 +1,263 @@
+/* gfSufa - find genoFind hits from exact matches in a suffix array.
+ * Rather than looking up every tile of the query, this looks for the
+ * longest exact match starting at a query position, and then carries on
+ * from just past where that match ends.  Long matches thus make for
+ * few lookups.  So that other copies of a repeat are not lost behind the
+ * copy that matches best, each lookup also takes every place that matches
+ * the start of the query as well, down to the shortest match that is
+ * found no more than repMatch times, and follows each of those as far as
+ * it goes.  Matches found in too many places are skipped as repeats rather
+ * than each contributing many tile sized hits. */
+
+#include "common.h"
+#include "dnaseq.h"
+#include "localmem.h"
+#include "bits.h"
+#include "hash.h"
+#include "sufa.h"
+#include "genoFind.h"
+
+static char sufaBase[256];	/* Lower case base for a, c, g, t, zero otherwise. */
+
+static void initSufaBase()
+/* Set up sufaBase lookup table. */
+{
+static boolean initted = FALSE;
+if (!initted)
+    {
+    sufaBase['a'] = sufaBase['A'] = 'a';
+    sufaBase['c'] = sufaBase['C'] = 'c';
+    sufaBase['g'] = sufaBase['G'] = 'g';
+    sufaBase['t'] = sufaBase['T'] = 't';
+    initted = TRUE;
+    }
+}
+
+void gfAttachSufa(struct genoFind *gf, struct sufa *sufa, int minMatch)
+/* Have gf seed alignments from exact matches of at least minMatch bases
+ * in sufa.  Each chromosome in sufa must be one of gf's sources.  The
+ * sufa is freed along with gf. */
+{
+int chromCount = sufa->header->chromCount;
+struct hash *hash = hashNew(0);
+int i;
+
+initSufaBase();
+for (i=0; i<gf->sourceCount; ++i)
+    {
+    struct gfSeqSource *ss = &gf->sources[i];
+    if (ss->seq == NULL)
+	errAbort("Suffix array seeds need sequence sources in index");
+    hashAddInt(hash, ss->seq->name, i);
+    }
+AllocArray(gf->sufaSources, chromCount);
+for (i=0; i<chromCount; ++i)
+    {
+    char *name = sufa->chromNames[i];
+    int sourceIx = hashIntValDefault(hash, name, -1);
+    struct gfSeqSource *ss;
+    if (sourceIx < 0)
+	errAbort("%s is in suffix array but not in database", name);
+    gf->sufaSources[i] = sourceIx;
+    ss = &gf->sources[sourceIx];
+    if (ss->end - ss->start != sufa->chromSizes[i])
+	errAbort("%s is %d bases in suffix array but %d in database", name,
+		sufa->chromSizes[i], ss->end - ss->start);
+    }
+hashFree(&hash);
+gf->sufa = sufa;
+gf->sufaMinMatch = minMatch;
+}
+
+static int sufaChromIx(struct sufa *sufa, bits32 offset)
+/* Return index of chromosome offset is in.  This is a binary search
+ * version of sufaOffsetToChromIx, relying on the chromosomes being laid
+ * out in order. */
+{
+bits32 *chromOffsets = sufa->chromOffsets;
+int lo = 0, hi = sufa->header->chromCount - 1;
+while (lo < hi)
+    {
+    int mid = (lo + hi + 1) / 2;
+    if (chromOffsets[mid] <= offset)
+	lo = mid;
+    else
+	hi = mid - 1;
+    }
+return lo;
+}
+
+static int sufaLongestMatch(struct sufa *sufa, DNA *dna, int size,
+	int seedSize, bits64 maxCount, bits64 *retLo, bits64 *retHi)
+/* Find longest prefix of dna that is in suffix array and return its size.
+ * The range is narrowed one base at a time with a pair of binary
+ * searches.  Along the way note the first range, starting with a prefix
+ * of at least seedSize, that holds no more than maxCount places, and
+ * return it in retLo/retHi.  If there is no such range retLo and retHi
+ * are equal. */
+{
+char *allDna = sufa->allDna;
+bits32 *array = sufa->array;
+bits64 lo = 0, hi = sufa->header->arraySize;
+int matchSize;
+
+*retLo = *retHi = 0;
+for (matchSize = 0; matchSize < size; ++matchSize)
+    {
+    char c = sufaBase[(UBYTE)dna[matchSize]];
+    bits64 a, b, newLo, newHi;
+    if (c == 0)
+	break;
+    /* Find start of range with c at matchSize. */
+    a = lo;
+    b = hi;
+    while (a < b)
+	{
+	bits64 mid = (a + b) >> 1;
+	if ((UBYTE)allDna[array[mid] + matchSize] < (UBYTE)c)
+	    a = mid + 1;
+	else
+	    b = mid;
+	}
+    newLo = a;
+    /* Find end of it. */
+    b = hi;
+    while (a < b)
+	{
+	bits64 mid = (a + b) >> 1;
+	if ((UBYTE)allDna[array[mid] + matchSize] <= (UBYTE)c)
+	    a = mid + 1;
+	else
+	    b = mid;
+	}
+    newHi = a;
+    if (newLo >= newHi)
+	break;
+    lo = newLo;
+    hi = newHi;
+    if (matchSize+1 >= seedSize && hi - lo <= maxCount && *retLo == *retHi)
+	{
+	*retLo = lo;
+	*retHi = hi;
+	}
+    }
+return matchSize;
+}
+
+static int sufaExtendMatch(char *tDna, DNA *qDna, int size, int matchSize)
+/* Return how far a match of matchSize bases between tDna and qDna goes
+ * on.  Target DNA is zero between chromosomes, so this stops at their
+ * ends. */
+{
+while (matchSize < size && tDna[matchSize] != 0
+	&& tDna[matchSize] == sufaBase[(UBYTE)qDna[matchSize]])
+    ++matchSize;
+return matchSize;
+}
+
+struct sufaMatch
+/* Places holding a match of part of the query. */
+    {
+    int qPos;		/* Start of match in query. */
+    int size;		/* Size of longest match. */
+    bits64 lo, hi;	/* Range of suffix array to seed from. */
+    };
+
+static int sufaFindMatches(struct genoFind *gf, DNA *dna, int size, int minMatch,
+	struct sufaMatch *matches)
+/* Look up query in gf->sufa, putting matches found into matches, and
+ * return how many there are.  There is room for one per minMatch+1
+ * bases. */
+{
+int qPos = 0, matchCount = 0;
+while (qPos <= size - minMatch)
+    {
+    struct sufaMatch *m = &matches[matchCount];
+    int matchSize = sufaLongestMatch(gf->sufa, dna + qPos, size - qPos,
+    	minMatch, gf->maxPat, &m->lo, &m->hi);
+    if (matchSize < minMatch)
+	{
+	++qPos;
+	continue;
+	}
+    m->qPos = qPos;
+    m->size = matchSize;
+    ++matchCount;
+    /* The base after the match is a mismatch with the best target, so
+     * start next match past it. */
+    qPos += matchSize + 1;
+    }
+return matchCount;
+}
+
+struct gfHit *gfSufaFindHits(struct genoFind *gf, struct dnaSeq *seq,
+	Bits *qMaskBits, int qMaskOffset, struct lm *lm, int *retHitCount,
+	struct gfSeqSource *target, int tMin, int tMax)
+/* Find hits associated with one sequence from the exact matches it has
+ * in gf->sufa.  Each match is reported as hits a tile apart along it, so
+ * that clumping treats it like the tile hits it stands in for.  The
+ * matches are all found before any of their places are looked at, so
+ * that ones with the most places can be left out to keep to the hit
+ * budget. */
+{
+struct gfHit *hitList = NULL, *hit;
+struct sufa *sufa = gf->sufa;
+int size = seq->size;
+int tileSize = gf->tileSize;
+int minMatch = max(gf->sufaMinMatch, tileSize);
+DNA *dna = seq->dna;
+int hitCount = 0;
+struct sufaMatch *matches;
+int matchCount, i;
+int *counts = NULL, maxCount = BIGNUM;
+
+lmAllocArray(lm, matches, size/(minMatch+1) + 1);
+matchCount = sufaFindMatches(gf, dna, size, minMatch, matches);
+if (target == NULL && (counts = gfHitBudgetCounts(matchCount)) != NULL)
+    {
+    /* No place makes more hits than the longest match would. */
+    for (i=0; i<matchCount; ++i)
+	{
+	bits64 count = (matches[i].hi - matches[i].lo) * (matches[i].size / tileSize);
+	counts[i] = min(count, BIGNUM);
+	}
+    maxCount = gfHitBudgetListCap(seq->name, counts, matchCount);
+    }
+for (i=0; i<matchCount; ++i)
+    {
+    int qPos = matches[i].qPos;
+    bits64 ix;
+    if (counts != NULL && counts[i] > maxCount)
+	continue;
+    /* Every place in lo to hi matches at least minMatch bases, but each
+     * may go on further than that. */
+    for (ix = matches[i].lo; ix < matches[i].hi; ++ix)
+	{
+	bits32 offset = sufa->array[ix];
+	int chromIx = sufaChromIx(sufa, offset);
+	struct gfSeqSource *ss = &gf->sources[gf->sufaSources[chromIx]];
+	bits32 tPos = ss->start + (offset - sufa->chromOffsets[chromIx]);
+	int placeSize, off;
+	if (target != NULL && target != ss)
+	    continue;
+	placeSize = sufaExtendMatch(sufa->allDna + offset, dna + qPos, size - qPos, minMatch);
+	for (off = 0; off + tileSize <= placeSize; off += tileSize)
+	    {
+	    int qStart = qPos + off;
+	    bits32 tStart = tPos + off;
+	    if (target != NULL && (tStart < tMin || tStart >= tMax))
+		continue;
+	    if (qMaskBits != NULL && bitCountRange(qMaskBits, qStart+qMaskOffset, tileSize) != 0)
+		continue;
+	    lmAllocVar(lm, hit);
+	    hit->qStart = qStart;
+	    hit->tStart = tStart;
+	    hit->diagonal = tStart + size - qStart;
+	    slAddHead(&hitList, hit);
+	    ++hitCount;
+	    }
+	}
+    }
+*retHitCount = hitCount;
+return hitList;
+}
@@ -0,0 +1,263 @@
+/* pslBin - binary version of psl alignment files, that is quick to write
+ * and to read back in.  See pslBin.h for the file format. */
+
+#include "common.h"
+#include "hash.h"
+#include "psl.h"
+#include "pslBin.h"
+#include "htslib/bgzf.h"
+
+struct pslBinOut *pslBinOutNew()
+/* Return state for a new stream of records. */
+{
+struct pslBinOut *pbo;
+AllocVar(pbo);
+return pbo;
+}
+
+void pslBinOutFree(struct pslBinOut **pPbo)
+/* Free up stream state. */
+{
+struct pslBinOut *pbo = *pPbo;
+if (pbo != NULL)
+    {
+    hashFree(&pbo->targetIds);
+    freeMem(pbo->lastQuery);
+    freez(pPbo);
+    }
+}
+
+void pslBinWriteHead(FILE *f, boolean textHead)
+/* Write pslBin file header. */
+{
+bits32 head[3];
+head[0] = pslBinSig;
+head[1] = pslBinVersion;
+head[2] = (textHead ? pslBinTextHead : 0);
+mustWrite(f, head, sizeof(head));
+}
+
+static void writeName(FILE *f, UBYTE type, int size, char *name)
+/* Write query or target record. */
+{
+bits32 nums[2];
+nums[0] = size;
+nums[1] = strlen(name);
+fputc(type, f);
+mustWrite(f, nums, sizeof(nums));
+mustWrite(f, name, nums[1]);
+}
+
+void pslBinWrite(struct pslBinOut *pbo, struct psl *psl, FILE *f)
+/* Write psl as records in stream.  Sequence in psl is not written. */
+{
+bits32 nums[14];
+char strand[4];
+int blockCount = psl->blockCount;
+int tId;
+
+if (pbo->targetIds == NULL)
+    {
+    pbo->targetIds = hashNew(10);
+    fputc(pslBinReset, f);
+    }
+if (pbo->lastQuery == NULL || pbo->lastQuerySize != psl->qSize
+    || differentString(pbo->lastQuery, psl->qName))
+    {
+    freeMem(pbo->lastQuery);
+    pbo->lastQuery = cloneString(psl->qName);
+    pbo->lastQuerySize = psl->qSize;
+    writeName(f, pslBinQuery, psl->qSize, psl->qName);
+    }
+tId = hashIntValDefault(pbo->targetIds, psl->tName, -1);
+if (tId < 0)
+    {
+    tId = pbo->targetCount++;
+    hashAddInt(pbo->targetIds, psl->tName, tId);
+    writeName(f, pslBinTarget, psl->tSize, psl->tName);
+    }
+nums[0] = psl->match;
+nums[1] = psl->misMatch;
+nums[2] = psl->repMatch;
+nums[3] = psl->nCount;
+nums[4] = psl->qNumInsert;
+nums[5] = psl->qBaseInsert;
+nums[6] = psl->tNumInsert;
+nums[7] = psl->tBaseInsert;
+nums[8] = psl->qStart;
+nums[9] = psl->qEnd;
+nums[10] = tId;
+nums[11] = psl->tStart;
+nums[12] = psl->tEnd;
+nums[13] = blockCount;
+zeroBytes(strand, sizeof(strand));
+strncpy(strand, psl->strand, 2);
+fputc(pslBinAli, f);
+mustWrite(f, nums, sizeof(nums));
+mustWrite(f, strand, sizeof(strand));
+mustWrite(f, psl->blockSizes, blockCount * sizeof(psl->blockSizes[0]));
+mustWrite(f, psl->qStarts, blockCount * sizeof(psl->qStarts[0]));
+mustWrite(f, psl->tStarts, blockCount * sizeof(psl->tStarts[0]));
+}
+
+static boolean readSome(struct pslBinFile *pbf, void *buf, int size)
+/* Read size bytes into buf.  Return FALSE at end of file before any are
+ * read, and abort if file ends part way through. */
+{
+ssize_t got = bgzf_read(pbf->bgzf, buf, size);
+if (got == 0 && size > 0)
+    return FALSE;
+if (got != size)
+    errAbort("%s is truncated or corrupt", pbf->fileName);
+return TRUE;
+}
+
+static void mustReadSome(struct pslBinFile *pbf, void *buf, int size)
+/* Read size bytes into buf or die trying. */
+{
+if (!readSome(pbf, buf, size))
+    errAbort("%s is truncated", pbf->fileName);
+}
+
+static void readNums(struct pslBinFile *pbf, bits32 *nums, int count)
+/* Read count 32 bit numbers, swapping bytes if need be. */
+{
+int i;
+mustReadSome(pbf, nums, count * sizeof(nums[0]));
+if (pbf->isSwapped)
+    for (i=0; i<count; ++i)
+	nums[i] = byteSwap32(nums[i]);
+}
+
+static char *readName(struct pslBinFile *pbf, int *retSize)
+/* Read size and name of query or target record. */
+{
+bits32 nums[2];
+char *name;
+readNums(pbf, nums, 2);
+*retSize = nums[0];
+name = needMem(nums[1] + 1);
+mustReadSome(pbf, name, nums[1]);
+return name;
+}
+
+static void resetNames(struct pslBinFile *pbf)
+/* Forget targets and query read so far. */
+{
+int i;
+for (i=0; i<pbf->tCount; ++i)
+    freeMem(pbf->tNames[i]);
+pbf->tCount = 0;
+freez(&pbf->qName);
+}
+
+struct pslBinFile *pslBinOpen(char *fileName)
+/* Open pslBin file and read header. */
+{
+struct pslBinFile *pbf;
+bits32 head[3];
+
+AllocVar(pbf);
+pbf->fileName = cloneString(fileName);
+if ((pbf->bgzf = bgzf_open(fileName, "r")) == NULL)
+    errnoAbort("Couldn't open %s", fileName);
+mustReadSome(pbf, head, sizeof(head));
+if (head[0] != pslBinSig)
+    {
+    if (byteSwap32(head[0]) != pslBinSig)
+	errAbort("%s is not a pslBin file", fileName);
+    pbf->isSwapped = TRUE;
+    head[1] = byteSwap32(head[1]);
+    head[2] = byteSwap32(head[2]);
+    }
+if (head[1] > pslBinVersion)
+    errAbort("%s is pslBin version %d, can only read up to %d", fileName,
+    	head[1], pslBinVersion);
+pbf->textHead = ((head[2] & pslBinTextHead) != 0);
+return pbf;
+}
+
+void pslBinClose(struct pslBinFile **pPbf)
+/* Close pslBin file and free up associated memory. */
+{
+struct pslBinFile *pbf = *pPbf;
+if (pbf != NULL)
+    {
+    resetNames(pbf);
+    bgzf_close(pbf->bgzf);
+    freeMem(pbf->tNames);
+    freeMem(pbf->tSizes);
+    freeMem(pbf->fileName);
+    freez(pPbf);
+    }
+}
+
+struct psl *pslBinNext(struct pslBinFile *pbf)
+/* Return next psl in file, or NULL at end.  Free with pslFree. */
+{
+UBYTE type;
+for (;;)
+    {
+    if (!readSome(pbf, &type, 1))
+	return NULL;
+    if (type == pslBinReset)
+	resetNames(pbf);
+    else if (type == pslBinQuery)
+	{
+	freeMem(pbf->qName);
+	pbf->qName = readName(pbf, &pbf->qSize);
+	}
+    else if (type == pslBinTarget)
+	{
+	if (pbf->tCount >= pbf->tAlloc)
+	    {
+	    int newAlloc = (pbf->tAlloc == 0 ? 64 : pbf->tAlloc * 2);
+	    ExpandArray(pbf->tNames, pbf->tAlloc, newAlloc);
+	    ExpandArray(pbf->tSizes, pbf->tAlloc, newAlloc);
+	    pbf->tAlloc = newAlloc;
+	    }
+	pbf->tNames[pbf->tCount] = readName(pbf, &pbf->tSizes[pbf->tCount]);
+	pbf->tCount += 1;
+	}
+    else if (type == pslBinAli)
+	{
+	struct psl *psl;
+	bits32 nums[14];
+	int blockCount;
+	bits32 tId;
+	readNums(pbf, nums, ArraySize(nums));
+	tId = nums[10];
+	if (pbf->qName == NULL || tId >= pbf->tCount)
+	    errAbort("Alignment before its query or target in %s", pbf->fileName);
+	AllocVar(psl);
+	psl->match = nums[0];
+	psl->misMatch = nums[1];
+	psl->repMatch = nums[2];
+	psl->nCount = nums[3];
+	psl->qNumInsert = nums[4];
+	psl->qBaseInsert = nums[5];
+	psl->tNumInsert = nums[6];
+	psl->tBaseInsert = nums[7];
+	psl->qStart = nums[8];
+	psl->qEnd = nums[9];
+	psl->tStart = nums[11];
+	psl->tEnd = nums[12];
+	psl->blockCount = blockCount = nums[13];
+	psl->qName = cloneString(pbf->qName);
+	psl->qSize = pbf->qSize;
+	psl->tName = cloneString(pbf->tNames[tId]);
+	psl->tSize = pbf->tSizes[tId];
+	mustReadSome(pbf, psl->strand, 2);
+	mustReadSome(pbf, nums, 2);	/* Padding. */
+	AllocArray(psl->blockSizes, blockCount);
+	AllocArray(psl->qStarts, blockCount);
+	AllocArray(psl->tStarts, blockCount);
+	readNums(pbf, psl->blockSizes, blockCount);
+	readNums(pbf, psl->qStarts, blockCount);
+	readNums(pbf, psl->tStarts, blockCount);
+	return psl;
+	}
+    else
+	errAbort("Unknown record type %d in %s", type, pbf->fileName);
+    }
+}
@@ -609,6 +609,29 @@ else
     return hel->name;
 }
 
+void hashClear(struct hash *hash)
+/* Remove all elements from hash, but keep the table and memory
+ * pool around so that the hash can be refilled cheaply. */
+{
+if (hash->lm)
+    lmReset(hash->lm);
+else
+    {
+    int i;
+    struct hashEl *hel, *next;
+    for (i=0; i<hash->size; ++i)
+	{
+	for (hel = hash->table[i]; hel != NULL; hel = next)
+	    {
+	    next = hel->next;
+	    freeHashEl(hel);
+	    }
+	}
+    }
+memset(hash->table, 0, hash->size * sizeof(hash->table[0]));
+hash->elCount = 0;
+}
+
 void freeHash(struct hash **pHash)
 /* Free up hash table. */
 {
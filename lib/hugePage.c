@@ -0,0 +1,220 @@
+/* hugePage - allocate big arrays backed by huge pages, to cut down on
+ * TLB misses when they are accessed at random. */
+
+#include "common.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include "hugePage.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+struct hugeBlock
+/* Memory mapped by hugePageAlloc. */
+    {
+    struct hugeBlock *next;
+    void *pt;		/* Start of mapping. */
+    size_t size;	/* Size of mapping. */
+    };
+
+static struct hugeBlock *hugeBlocks = NULL;	/* All mappings made. */
+static pthread_mutex_t hugeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t thpPageSize()
+/* Return size of transparent huge pages. */
+{
+static size_t size = 0;
+if (size == 0)
+    {
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    unsigned long long x = 0;
+    if (f != NULL)
+	{
+	if (fscanf(f, "%llu", &x) != 1)
+	    x = 0;
+	fclose(f);
+	}
+    size = (x > 0 ? x : 2*1024*1024);
+    }
+return size;
+}
+
+static size_t roundUp(size_t size, size_t pageSize)
+/* Round size up to multiple of page size. */
+{
+return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+static void *thpAlloc(size_t size)
+/* Map memory aligned on huge page boundary, and ask for it to be
+ * backed by transparent huge pages. */
+{
+#ifdef MADV_HUGEPAGE
+size_t pageSize = thpPageSize();
+size_t mapSize = roundUp(size, pageSize) + pageSize;
+char *base = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+char *pt, *end;
+if (base == MAP_FAILED)
+    return NULL;
+
+/* Trim off the unaligned ends. */
+pt = (char *)roundUp((size_t)base, pageSize);
+end = pt + roundUp(size, pageSize);
+if (pt > base)
+    munmap(base, pt - base);
+if (base + mapSize > end)
+    munmap(end, base + mapSize - end);
+madvise(pt, end - pt, MADV_HUGEPAGE);
+return pt;
+#else
+return NULL;
+#endif
+}
+
+static void *hugetlbAlloc(size_t size, size_t pageSize)
+/* Map memory from kernel's pool of huge pages of given size. */
+{
+#ifdef MAP_HUGETLB
+int log2Size = 0;
+void *pt;
+while (((size_t)1 << log2Size) < pageSize)
+    ++log2Size;
+pt = mmap(NULL, roundUp(size, pageSize), PROT_READ|PROT_WRITE,
+	MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(log2Size << MAP_HUGE_SHIFT), -1, 0);
+return (pt == MAP_FAILED ? NULL : pt);
+#else
+return NULL;
+#endif
+}
+
+static void *hugetlbfsAlloc(size_t size, char *dir, size_t *retSize)
+/* Map memory from an unlinked file in a hugetlbfs directory. */
+{
+char path[PATH_LEN];
+struct statfs fs;
+int fd;
+void *pt;
+
+/* The block size of a hugetlbfs mount is its page size. */
+if (statfs(dir, &fs) != 0 || fs.f_bsize <= getpagesize())
+    return NULL;
+safef(path, sizeof(path), "%s/blatIndexXXXXXX", dir);
+if ((fd = mkstemp(path)) < 0)
+    return NULL;
+unlink(path);
+*retSize = roundUp(size, fs.f_bsize);
+if (ftruncate(fd, *retSize) != 0)
+    {
+    close(fd);
+    return NULL;
+    }
+pt = mmap(NULL, *retSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+close(fd);
+return (pt == MAP_FAILED ? NULL : pt);
+}
+
+void *hugePageAlloc(size_t size, char *spec)
+/* Allocate size bytes of zeroed memory backed by huge pages as described
+ * by spec, which is one of:
+ *     thp - transparent huge pages, via madvise
+ *     2M or 1G - pages of that size from the kernel's hugetlb pool
+ *     a directory - file in a mounted hugetlbfs
+ * Returns NULL if that kind of memory can't be had. */
+{
+void *pt = NULL;
+size_t mapSize = size;
+struct hugeBlock *hb;
+
+if (sameWord(spec, "thp"))
+    {
+    pt = thpAlloc(size);
+    mapSize = roundUp(size, thpPageSize());
+    }
+else if (sameWord(spec, "2M"))
+    {
+    pt = hugetlbAlloc(size, 2*1024*1024);
+    mapSize = roundUp(size, 2*1024*1024);
+    }
+else if (sameWord(spec, "1G"))
+    {
+    pt = hugetlbAlloc(size, 1024*1024*1024);
+    mapSize = roundUp(size, 1024*1024*1024);
+    }
+else
+    pt = hugetlbfsAlloc(size, spec, &mapSize);
+if (pt == NULL)
+    return NULL;
+hb = needMem(sizeof(*hb));
+hb->pt = pt;
+hb->size = mapSize;
+pthread_mutex_lock(&hugeMutex);
+slAddHead(&hugeBlocks, hb);
+pthread_mutex_unlock(&hugeMutex);
+return pt;
+}
+
+boolean hugePageFree(void *pt)
+/* Free memory from hugePageAlloc.  Returns FALSE, doing nothing, if pt
+ * did not come from hugePageAlloc. */
+{
+struct hugeBlock *hb, **pHb;
+if (pt == NULL)
+    return FALSE;
+pthread_mutex_lock(&hugeMutex);
+for (pHb = &hugeBlocks; (hb = *pHb) != NULL; pHb = &hb->next)
+    {
+    if (hb->pt == pt)
+	{
+	*pHb = hb->next;
+	break;
+	}
+    }
+pthread_mutex_unlock(&hugeMutex);
+if (hb == NULL)
+    return FALSE;
+munmap(hb->pt, hb->size);
+freeMem(hb);
+return TRUE;
+}
+
+size_t hugePageBacked(void *pt, size_t size, size_t *retPageSize)
+/* Return how many bytes of block are currently backed by huge pages,
+ * and the size of those pages.  Returns 0 if none or if this can't
+ * be determined. */
+{
+FILE *f = fopen("/proc/self/smaps", "r");
+char line[512];
+unsigned long long start, end, kb;
+boolean inBlock = FALSE;
+size_t backed = 0, pageSize = 0;
+size_t first = (size_t)pt, last = (size_t)pt + size;
+
+if (f == NULL)
+    return 0;
+while (fgets(line, sizeof(line), f) != NULL)
+    {
+    if (sscanf(line, "%llx-%llx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' '))
+	inBlock = (start < last && end > first);
+    else if (inBlock)
+	{
+	if (sscanf(line, "KernelPageSize: %llu kB", &kb) == 1 && kb*1024 > getpagesize())
+	    {
+	    /* Mapping is from hugetlb, so all of it is on huge pages. */
+	    pageSize = kb*1024;
+	    backed += min(end, last) - max(start, first);
+	    }
+	else if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1 && kb > 0)
+	    {
+	    pageSize = thpPageSize();
+	    backed += min(kb*1024, min(end, last) - max(start, first));
+	    }
+	}
+    }
+fclose(f);
+if (retPageSize != NULL)
+    *retPageSize = pageSize;
+return backed;
+}
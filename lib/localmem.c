@@ -15,6 +15,7 @@
 struct lm
     {
     struct lmBlock *blocks;
+    struct lmBlock *spares;	/* Blocks set aside by lmReset for reuse. */
     size_t blockSize;
     size_t allignMask;
     size_t allignAdd;
@@ -28,12 +29,33 @@ struct lmBlock
     char *extra;
     };
 
+static struct lmBlock *reuseBlock(struct lm *lm, size_t reqSize)
+/* Move a spare block of at least reqSize to the head of the block list
+ * and return it.  Returns NULL if there is no spare big enough. */
+{
+struct lmBlock *mb, **pMb;
+for (pMb = &lm->spares; (mb = *pMb) != NULL; pMb = &mb->next)
+    {
+    if (mb->end - mb->free >= reqSize)
+        {
+	*pMb = mb->next;
+	mb->next = lm->blocks;
+	lm->blocks = mb;
+	return mb;
+	}
+    }
+return NULL;
+}
+
 static struct lmBlock *newBlock(struct lm *lm, size_t reqSize)
 /* Allocate a new block of at least reqSize */
 {
+struct lmBlock *mb;
+if (lm->spares != NULL && (mb = reuseBlock(lm, reqSize)) != NULL)
+    return mb;
 size_t size = (reqSize > lm->blockSize ? reqSize : lm->blockSize);
 size_t fullSize = size + sizeof(struct lmBlock);
-struct lmBlock *mb = needLargeZeroedMem(fullSize);
+mb = needLargeZeroedMem(fullSize);
 if (mb == NULL)
     errAbort("Couldn't allocate %lld bytes", (long long)fullSize);
 mb->free = (char *)(mb+1);
@@ -54,6 +76,7 @@ if (aliSize < sizeof(void *))
     aliSize = sizeof(void *);
 lm = needMem(sizeof(*lm));
 lm->blocks = NULL;
+lm->spares = NULL;
 if (blockSize <= 0)
     blockSize = (1<<14);    /* 16k default. */
 lm->blockSize = blockSize;
@@ -70,10 +93,53 @@ void lmCleanup(struct lm **pLm)
     if (lm == NULL)
         return;
     slFreeList(&lm->blocks);
+    slFreeList(&lm->spares);
     freeMem(lm);
     *pLm = NULL;
 }
 
+void lmReset(struct lm *lm)
+/* Make all memory in pool available again without giving it back to the
+ * system.  Memory handed out before the reset is zeroed, and later
+ * requests are carved out of the old blocks before new ones are made. */
+{
+struct lmBlock *mb, *next;
+for (mb = lm->blocks; mb != NULL; mb = next)
+    {
+    char *start = (char *)(mb+1);
+    next = mb->next;
+    memset(start, 0, mb->free - start);
+    mb->free = start;
+    if (mb != lm->blocks)
+        slAddHead(&lm->spares, mb);
+    }
+if (lm->blocks != NULL)
+    lm->blocks->next = NULL;
+}
+
+void lmTrim(struct lm *lm, size_t maxSpare)
+/* Give spare blocks set aside by lmReset back to the system once they
+ * add up to more than maxSpare bytes, so that one big use of a pool that
+ * is reset and reused doesn't hold on to its peak size for good. */
+{
+struct lmBlock *mb, **pMb = &lm->spares;
+size_t spare = 0;
+while ((mb = *pMb) != NULL)
+    {
+    size_t size = mb->end - (char *)mb;
+    if (spare + size > maxSpare)
+        {
+	*pMb = mb->next;
+	freeMem(mb);
+	}
+    else
+        {
+	spare += size;
+	pMb = &mb->next;
+	}
+    }
+}
+
 size_t lmAvailable(struct lm *lm)
 // Returns currently available memory in pool
 {
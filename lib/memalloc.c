@@ -433,6 +433,397 @@ carefulMemInit(maxAlloc);
 carefulParent = pushMemHandler(&carefulMemHandler);
 }
 
+/* The slab memory handler keeps a cache of freed blocks for each
+ * thread, sorted into size classes, so that most requests can be
+ * satisfied without taking any lock.  Blocks come from big chunks
+ * obtained from the parent handler and are never given back, although
+ * a thread that has more cached than it is likely to need passes the
+ * extra to a shared depot where other threads can pick it up.  Requests
+ * bigger than the largest size class go straight to the parent.  Chunks
+ * are aligned on their size and recorded in a two level map indexed by
+ * address, so a block being freed can be told to be ours without looking
+ * in front of it.  Anything not in a chunk belongs to the parent, either
+ * because it is big or because it was allocated before the handler was
+ * pushed. */
+
+#define slabSmallCount 16		/* Classes spaced 16 bytes apart up to 256. */
+#define slabClassCount 44		/* ...then four per doubling up to 32k. */
+#define slabMaxSize (32*1024)		/* Largest size class. */
+#define slabChunkShift 20		/* Log2 of size of chunks carved into blocks. */
+#define slabChunkSize ((size_t)1 << slabChunkShift)
+#define slabRegionChunks 16		/* Chunks gotten from parent at a time. */
+#define slabMapBits 14			/* Bits of chunk number resolved at each map level. */
+#define slabCacheBytes (256*1024)	/* Rough limit on each thread's cache per class. */
+
+struct slabHead
+/* Sits just in front of each block carved from a chunk. */
+    {
+    size_t size;		/* Usable size of block. */
+    size_t spare;		/* Keeps blocks 16 byte aligned. */
+    };
+
+struct slabFree
+/* A free block, linked into a free list through its first bytes. */
+    {
+    struct slabFree *next;
+    };
+
+struct slabStats
+/* Counts kept per thread and summed up for reporting. */
+    {
+    bits64 allocs[slabClassCount+1];	/* Allocations per class, last is big blocks. */
+    bits64 frees[slabClassCount+1];	/* Frees per class, last is blocks of parent. */
+    bits64 fromDepot;			/* Blocks taken from shared depot. */
+    bits64 toDepot;			/* Blocks given to shared depot. */
+    bits64 chunkBytes;			/* Bytes gotten from parent in chunks. */
+    };
+
+struct slabCache
+/* Per-thread cache of free blocks. */
+    {
+    struct slabCache *next;		/* Next in list of live caches. */
+    struct slabFree *free[slabClassCount];	/* Free blocks for each class. */
+    int freeCount[slabClassCount];	/* Number of blocks in each free list. */
+    char *chunkFree, *chunkEnd;		/* Unused part of current chunk. */
+    struct slabStats stats;		/* Usage counts for this thread. */
+    };
+
+static pthread_mutex_t slabMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slabKey;
+static pthread_once_t slabOnce = PTHREAD_ONCE_INIT;
+static struct memHandler *slabParent;
+static struct slabFree *slabDepot[slabClassCount];	/* Shared by all threads. */
+static int slabDepotCount[slabClassCount];
+static struct slabCache *slabLiveCaches;	/* Caches of running threads. */
+static struct slabStats slabRetired;	/* Counts from threads that have exited. */
+static size_t slabClassSize[slabClassCount];
+static int slabClassLimit[slabClassCount];
+static char *slabRegionFree, *slabRegionEnd;	/* Aligned chunks not yet handed out. */
+static unsigned char *slabMap[1<<slabMapBits];	/* Nonzero for each chunk we own. */
+
+static boolean slabOwns(void *vpt)
+/* Return TRUE if vpt lies in one of our chunks.  Called without the lock;
+ * a chunk is marked before any block in it is handed out and never
+ * unmarked. */
+{
+bits64 chunkIx = (bits64)(size_t)vpt >> slabChunkShift;
+unsigned char *leaf;
+if ((chunkIx >> (2*slabMapBits)) != 0)
+    return FALSE;
+leaf = __atomic_load_n(&slabMap[chunkIx >> slabMapBits], __ATOMIC_ACQUIRE);
+if (leaf == NULL)
+    return FALSE;
+return __atomic_load_n(&leaf[chunkIx & ((1<<slabMapBits)-1)], __ATOMIC_ACQUIRE) != 0;
+}
+
+static char *slabNewChunk()
+/* Return a fresh aligned chunk, marked in the map as ours. */
+{
+char *chunk = NULL;
+bits64 chunkIx;
+unsigned char **pLeaf;
+
+pthread_mutex_lock(&slabMutex);
+if (slabRegionEnd - slabRegionFree < slabChunkSize)
+    {
+    char *region = slabParent->alloc((slabRegionChunks+1) * slabChunkSize);
+    if (region == NULL)
+        goto done;
+    slabRegionFree = (char *)(((size_t)region + slabChunkSize - 1) & ~(slabChunkSize - 1));
+    slabRegionEnd = slabRegionFree + slabRegionChunks * slabChunkSize;
+    }
+chunkIx = (bits64)(size_t)slabRegionFree >> slabChunkShift;
+if ((chunkIx >> (2*slabMapBits)) != 0)
+    {
+    pthread_mutex_unlock(&slabMutex);
+    errAbort("slab memory handler: chunk address %p out of range", slabRegionFree);
+    }
+pLeaf = &slabMap[chunkIx >> slabMapBits];
+if (*pLeaf == NULL)
+    {
+    unsigned char *leaf = slabParent->alloc(1<<slabMapBits);
+    if (leaf == NULL)
+        goto done;
+    memset(leaf, 0, 1<<slabMapBits);
+    __atomic_store_n(pLeaf, leaf, __ATOMIC_RELEASE);
+    }
+__atomic_store_n(&(*pLeaf)[chunkIx & ((1<<slabMapBits)-1)], 1, __ATOMIC_RELEASE);
+chunk = slabRegionFree;
+slabRegionFree += slabChunkSize;
+done:
+pthread_mutex_unlock(&slabMutex);
+return chunk;
+}
+
+static int slabClassIx(size_t size)
+/* Return index of smallest size class that holds size bytes. */
+{
+int bit;
+size_t x;
+if (size <= 256)
+    return (size == 0 ? 0 : (size-1) >> 4);
+x = size - 1;
+for (bit = 8; (x >> (bit+1)) != 0; ++bit)
+    ;
+return slabSmallCount + (bit-8)*4 + ((x >> (bit-2)) & 3);
+}
+
+static void slabAddStats(struct slabStats *acc, struct slabStats *st)
+/* Add counts in st to acc. */
+{
+int i;
+for (i=0; i<=slabClassCount; ++i)
+    {
+    acc->allocs[i] += st->allocs[i];
+    acc->frees[i] += st->frees[i];
+    }
+acc->fromDepot += st->fromDepot;
+acc->toDepot += st->toDepot;
+acc->chunkBytes += st->chunkBytes;
+}
+
+static void slabCacheFree(void *v)
+/* Give cached blocks of an exiting thread to the depot. */
+{
+struct slabCache *sc = v, **pSc;
+int i;
+pthread_mutex_lock(&slabMutex);
+for (i=0; i<slabClassCount; ++i)
+    {
+    struct slabFree *el, *next;
+    for (el = sc->free[i]; el != NULL; el = next)
+        {
+	next = el->next;
+	el->next = slabDepot[i];
+	slabDepot[i] = el;
+	}
+    slabDepotCount[i] += sc->freeCount[i];
+    sc->stats.toDepot += sc->freeCount[i];
+    }
+for (pSc = &slabLiveCaches; *pSc != NULL; pSc = &(*pSc)->next)
+    {
+    if (*pSc == sc)
+        {
+	*pSc = sc->next;
+	break;
+	}
+    }
+slabAddStats(&slabRetired, &sc->stats);
+pthread_mutex_unlock(&slabMutex);
+slabParent->free(sc);
+}
+
+static void slabInit()
+/* Set up size classes and thread key. */
+{
+int i;
+for (i=0; i<slabClassCount; ++i)
+    {
+    if (i < slabSmallCount)
+        slabClassSize[i] = (i+1) << 4;
+    else
+        {
+	int doubling = (i - slabSmallCount)/4, step = (i - slabSmallCount)%4;
+	slabClassSize[i] = ((size_t)256 << doubling) + (step+1) * ((size_t)64 << doubling);
+	}
+    slabClassLimit[i] = slabCacheBytes / slabClassSize[i];
+    if (slabClassLimit[i] < 64)
+        slabClassLimit[i] = 64;
+    }
+if (pthread_key_create(&slabKey, slabCacheFree) != 0)
+    errAbort("Couldn't create thread key for slab memory handler");
+}
+
+static struct slabCache *slabCacheForThread()
+/* Return cache of current thread, making it if need be. */
+{
+struct slabCache *sc = pthread_getspecific(slabKey);
+if (sc == NULL)
+    {
+    sc = slabParent->alloc(sizeof(*sc));
+    if (sc == NULL)
+        return NULL;
+    memset(sc, 0, sizeof(*sc));
+    pthread_setspecific(slabKey, sc);
+    pthread_mutex_lock(&slabMutex);
+    sc->next = slabLiveCaches;
+    slabLiveCaches = sc;
+    pthread_mutex_unlock(&slabMutex);
+    }
+return sc;
+}
+
+static void *slabAllocBig(struct slabCache *sc, size_t size)
+/* Get block too big for any size class from parent. */
+{
+sc->stats.allocs[slabClassCount] += 1;
+return slabParent->alloc(size);
+}
+
+static void *slabAlloc(size_t size)
+/* Get block from thread's cache, the depot, or a fresh chunk, in
+ * that order of preference. */
+{
+struct slabCache *sc = slabCacheForThread();
+struct slabHead *head;
+struct slabFree *el;
+int ix, want;
+size_t fullSize;
+
+if (sc == NULL)
+    return NULL;
+if (size > slabMaxSize)
+    return slabAllocBig(sc, size);
+ix = slabClassIx(size);
+sc->stats.allocs[ix] += 1;
+if ((el = sc->free[ix]) != NULL)
+    {
+    sc->free[ix] = el->next;
+    sc->freeCount[ix] -= 1;
+    return el;
+    }
+/* Other threads change the depot, so only look at it under the lock. */
+pthread_mutex_lock(&slabMutex);
+for (want = slabClassLimit[ix]/2; want > 0 && (el = slabDepot[ix]) != NULL; --want)
+    {
+    slabDepot[ix] = el->next;
+    el->next = sc->free[ix];
+    sc->free[ix] = el;
+    sc->freeCount[ix] += 1;
+    slabDepotCount[ix] -= 1;
+    sc->stats.fromDepot += 1;
+    }
+pthread_mutex_unlock(&slabMutex);
+if ((el = sc->free[ix]) != NULL)
+    {
+    sc->free[ix] = el->next;
+    sc->freeCount[ix] -= 1;
+    return el;
+    }
+fullSize = slabClassSize[ix] + sizeof(*head);
+if (sc->chunkEnd - sc->chunkFree < fullSize)
+    {
+    char *chunk = slabNewChunk();
+    if (chunk == NULL)
+        return NULL;
+    sc->chunkFree = chunk;
+    sc->chunkEnd = chunk + slabChunkSize;
+    sc->stats.chunkBytes += slabChunkSize;
+    }
+head = (struct slabHead *)sc->chunkFree;
+sc->chunkFree += fullSize;
+head->size = slabClassSize[ix];
+return head+1;
+}
+
+static void slabFree(void *vpt)
+/* Put block on thread's free list, passing half of list on to depot
+ * if it gets too long.  Big blocks and blocks that were allocated before
+ * the slab handler was pushed go back to the parent. */
+{
+struct slabHead *head = ((struct slabHead *)vpt)-1;
+struct slabCache *sc;
+struct slabFree *el = vpt;
+int ix;
+
+if (!slabOwns(vpt))
+    {
+    if ((sc = pthread_getspecific(slabKey)) != NULL)
+        sc->stats.frees[slabClassCount] += 1;
+    slabParent->free(vpt);
+    return;
+    }
+sc = slabCacheForThread();
+if (sc == NULL)
+    errAbort("slabFree: couldn't make thread cache");
+ix = slabClassIx(head->size);
+sc->stats.frees[ix] += 1;
+el->next = sc->free[ix];
+sc->free[ix] = el;
+if (++sc->freeCount[ix] > slabClassLimit[ix])
+    {
+    int give = slabClassLimit[ix]/2;
+    sc->stats.toDepot += give;
+    sc->freeCount[ix] -= give;
+    pthread_mutex_lock(&slabMutex);
+    slabDepotCount[ix] += give;
+    while (--give >= 0)
+        {
+	el = sc->free[ix];
+	sc->free[ix] = el->next;
+	el->next = slabDepot[ix];
+	slabDepot[ix] = el;
+	}
+    pthread_mutex_unlock(&slabMutex);
+    }
+}
+
+static void *slabRealloc(void *vpt, size_t size)
+/* Resize a block, keeping it in place if it already has room. */
+{
+struct slabHead *head;
+void *newBlk;
+if (vpt == NULL)
+    return slabAlloc(size);
+if (!slabOwns(vpt))
+    return slabParent->realloc(vpt, size);
+head = ((struct slabHead *)vpt)-1;
+if (size <= head->size)
+    return vpt;
+if ((newBlk = slabAlloc(size)) == NULL)
+    return NULL;
+memcpy(newBlk, vpt, min(size, head->size));
+slabFree(vpt);
+return newBlk;
+}
+
+static struct memHandler slabMemHandler =
+/* Per-thread caching slab memory handler. */
+    {
+    NULL,
+    slabAlloc,
+    slabFree,
+    slabRealloc,
+    };
+
+void pushSlabMemHandler()
+/* Push a memory handler that keeps per-thread caches of freed
+ * blocks sorted by size class, which cuts down on lock contention in
+ * the system malloc when many threads are allocating at once.  Best
+ * pushed early, before threads are started. */
+{
+pthread_once(&slabOnce, slabInit);
+slabParent = pushMemHandler(&slabMemHandler);
+}
+
+void slabMemReport(FILE *f)
+/* Write usage counts of slab memory handler to f. */
+{
+struct slabStats sum;
+struct slabCache *sc;
+int i;
+
+if (slabParent == NULL)
+    return;
+ZeroVar(&sum);
+pthread_mutex_lock(&slabMutex);
+slabAddStats(&sum, &slabRetired);
+for (sc = slabLiveCaches; sc != NULL; sc = sc->next)
+    slabAddStats(&sum, &sc->stats);
+fprintf(f, "slab memory: %llu bytes in chunks, %llu blocks from depot, %llu to depot\n",
+	sum.chunkBytes, sum.fromDepot, sum.toDepot);
+fprintf(f, "%8s %12s %12s %10s\n", "size", "allocs", "frees", "inDepot");
+for (i=0; i<slabClassCount; ++i)
+    {
+    if (sum.allocs[i] != 0)
+	fprintf(f, "%8llu %12llu %12llu %10d\n", (bits64)slabClassSize[i],
+		sum.allocs[i], sum.frees[i], slabDepotCount[i]);
+    }
+fprintf(f, "%8s %12llu %12llu\n", "big", sum.allocs[slabClassCount],
+	sum.frees[slabClassCount]);
+pthread_mutex_unlock(&slabMutex);
+}
+
 struct memTracker
 /* A structure to keep track of memory. */
     {
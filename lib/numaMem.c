@@ -0,0 +1,140 @@
+/* numaMem - place memory and threads on the nodes of a NUMA machine.
+ * Talks to the kernel directly rather than through libnuma, so there
+ * is nothing extra to link against. */
+
+#include "common.h"
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "numaMem.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define numaMaxNodes 64		/* Nodes beyond this are ignored. */
+
+/* Memory policies from linux/mempolicy.h */
+#define mpolPreferred 1
+#define mpolInterleave 3
+
+static int nodeCount = 1;		/* Number of nodes online. */
+static int nodeIds[numaMaxNodes];	/* Kernel's id for each node, which may have gaps. */
+static pthread_once_t nodeOnce = PTHREAD_ONCE_INIT;
+
+static char *nextRange(char *s, long *retFirst, long *retLast)
+/* Parse next range from a kernel list like 0-15,32-47 into first and
+ * last.  Returns position after range, or NULL at end of list. */
+{
+char *e;
+if (!isdigit(*s))
+    return NULL;
+*retFirst = *retLast = strtol(s, &e, 10);
+if (*e == '-')
+    *retLast = strtol(e+1, &e, 10);
+return (*e == ',' ? e+1 : e);
+}
+
+static void findNodes()
+/* Read ids of online nodes.  Leaves a single node 0 if they can't be read. */
+{
+char buf[4096], *s;
+long first, last, i;
+int count = 0;
+FILE *f = fopen("/sys/devices/system/node/online", "r");
+if (f == NULL)
+    return;
+s = fgets(buf, sizeof(buf), f);
+fclose(f);
+if (s == NULL)
+    return;
+while ((s = nextRange(s, &first, &last)) != NULL)
+    {
+    for (i = first; i <= last && i < numaMaxNodes && count < numaMaxNodes; ++i)
+	nodeIds[count++] = i;
+    }
+if (count > 0)
+    nodeCount = count;
+}
+
+int numaNodeCount()
+/* Return number of NUMA nodes with memory, 1 if not a NUMA system. */
+{
+pthread_once(&nodeOnce, findNodes);
+return nodeCount;
+}
+
+static void setMemPolicy(void *pt, size_t size, int mode, unsigned long nodeMask)
+/* Apply memory policy to whole pages within block. */
+{
+#if defined(__linux__) && defined(SYS_mbind)
+size_t pageSize = sysconf(_SC_PAGESIZE);
+size_t start = ((size_t)pt + pageSize - 1) & ~(pageSize - 1);
+size_t end = ((size_t)pt + size) & ~(pageSize - 1);
+if (end > start)
+    syscall(SYS_mbind, (void *)start, end - start, mode, &nodeMask,
+	    sizeof(nodeMask)*8, 0);
+#endif
+}
+
+void numaInterleaveMem(void *pt, size_t size)
+/* Ask for the pages of a block to be spread evenly across all nodes.
+ * Only has effect on pages not yet touched. */
+{
+unsigned long nodeMask = 0;
+int i;
+if (numaNodeCount() > 1)
+    {
+    for (i=0; i<nodeCount; ++i)
+	nodeMask |= 1UL << nodeIds[i];
+    setMemPolicy(pt, size, mpolInterleave, nodeMask);
+    }
+}
+
+void numaPreferMem(void *pt, size_t size, int node)
+/* Ask for the pages of a block to come from the given node where
+ * possible.  Nodes are numbered from 0 to numaNodeCount()-1 whatever
+ * ids the kernel gives them.  Only has effect on pages not yet touched. */
+{
+if (numaNodeCount() > 1 && node >= 0 && node < nodeCount)
+    setMemPolicy(pt, size, mpolPreferred, 1UL << nodeIds[node]);
+}
+
+boolean numaBindThread(int node)
+/* Restrict calling thread to the cpus of node, numbered as for
+ * numaPreferMem.  Returns FALSE if that can't be done. */
+{
+#ifdef CPU_SET
+char path[256], buf[4096], *s;
+long first, last, i;
+FILE *f;
+cpu_set_t cpus;
+int cpuCount = 0;
+
+if (node < 0 || node >= numaNodeCount())
+    return FALSE;
+
+safef(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodeIds[node]);
+if ((f = fopen(path, "r")) == NULL)
+    return FALSE;
+s = fgets(buf, sizeof(buf), f);
+fclose(f);
+if (s == NULL)
+    return FALSE;
+
+CPU_ZERO(&cpus);
+while ((s = nextRange(s, &first, &last)) != NULL)
+    {
+    for (i = first; i <= last && i < CPU_SETSIZE; ++i)
+	{
+	CPU_SET(i, &cpus);
+	++cpuCount;
+	}
+    }
+if (cpuCount == 0)
+    return FALSE;
+return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+return FALSE;
+#endif
+}
@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include <sys/mman.h>
+#include "dnaseq.h"
 #include "sufa.h"
 
 static void *pointerOffset(void *pt, bits64 offset)
@@ -140,3 +141,161 @@ errAbort("tOffset %d out of range\n", tOffset);
 return -1;
 }
 
+
+static boolean sufaIndexedBase(char c)
+/* Return TRUE if base gets put in suffix array. */
+{
+return c == 'a' || c == 'c' || c == 'g' || c == 't';
+}
+
+static void countingSort(bits32 *source, bits32 *dest, bits32 size, 
+	bits32 *rank, bits32 maxRank, bits32 *count)
+/* Do stable sort of positions in source into dest by their rank. */
+{
+bits32 i, total = 0;
+for (i=0; i<=maxRank; ++i)
+    count[i] = 0;
+for (i=0; i<size; ++i)
+    count[rank[source[i]]] += 1;
+for (i=0; i<=maxRank; ++i)
+    {
+    bits32 c = count[i];
+    count[i] = total;
+    total += c;
+    }
+for (i=0; i<size; ++i)
+    dest[count[rank[source[i]]]++] = source[i];
+}
+
+static void sortSuffixes(char *text, bits32 size, bits32 *sa)
+/* Fill in sa with all positions in text in alphabetical order of the
+ * suffixes starting there.  This works by prefix doubling - once the
+ * suffixes are sorted on their first h letters, sorting them on pairs
+ * of ranks at i and i+h sorts them on their first 2h letters. */
+{
+bits32 rankSize = max(size, 256);
+bits32 *rank = needHugeMem(rankSize * sizeof(rank[0]));
+bits32 *newRank = needHugeMem(rankSize * sizeof(newRank[0]));
+bits32 *byLast = needHugeMem(size * sizeof(byLast[0]));
+bits32 *swap;
+bits32 i, k, h, maxRank = 255;
+
+for (i=0; i<size; ++i)
+    {
+    rank[i] = (UBYTE)text[i];
+    byLast[i] = i;
+    }
+countingSort(byLast, sa, size, rank, maxRank, newRank);
+for (h=1; ; h <<= 1)
+    {
+    /* Order by rank at i+h, counting positions past the end as lowest,
+     * and then do a stable sort of that by rank at i. */
+    k = 0;
+    for (i = (size > h ? size - h : 0); i<size; ++i)
+	byLast[k++] = i;
+    for (i=0; i<size; ++i)
+	if (sa[i] >= h)
+	    byLast[k++] = sa[i] - h;
+    countingSort(byLast, sa, size, rank, maxRank, newRank);
+
+    /* Figure out new ranks, which are the same for suffixes that
+     * match in first 2h letters. */
+    newRank[sa[0]] = 0;
+    for (i=1; i<size; ++i)
+	{
+	bits32 a = sa[i-1], b = sa[i];
+	bits32 aNext = (a + h < size ? rank[a+h] + 1 : 0);
+	bits32 bNext = (b + h < size ? rank[b+h] + 1 : 0);
+	newRank[b] = newRank[a] + (rank[a] != rank[b] || aNext != bNext);
+	}
+    maxRank = newRank[sa[size-1]];
+    swap = rank;
+    rank = newRank;
+    newRank = swap;
+    if (maxRank == size-1 || h >= size)
+	break;
+    }
+freeMem(rank);
+freeMem(newRank);
+freeMem(byLast);
+}
+
+struct sufa *sufaFromSeqs(struct dnaSeq *seqList)
+/* Make a suffix array for seqList in memory, laid out just as sufaRead
+ * would leave it.  Only lower case a, c, g and t get indexed.  Anything
+ * else, including upper case bases, which can be used for masking, is
+ * stored as n.  Sorting needs about 16 bytes of temporary memory per
+ * base. */
+{
+struct dnaSeq *seq;
+int chromCount = slCount(seqList);
+bits64 namesSize = 0, dnaSize = 0, arraySize = 0;
+int i;
+
+for (seq = seqList; seq != NULL; seq = seq->next)
+    {
+    namesSize += strlen(seq->name) + 1;
+    dnaSize += seq->size + 1;
+    for (i=0; i<seq->size; ++i)
+	if (sufaIndexedBase(seq->dna[i]))
+	    ++arraySize;
+    }
+namesSize = ((namesSize + 3) & ~3);
+dnaSize = ((dnaSize + 3) & ~3);
+if (dnaSize >= 0xffffffffLL)
+    errAbort("Too much sequence (%lld bases) for a suffix array", (long long)dnaSize);
+
+/* Allocate one block with room for everything, and fill in header. */
+bits64 size = sizeof(struct sufaFileHeader) + namesSize + chromCount * sizeof(bits32)
+	+ dnaSize + arraySize * sizeof(bits32);
+struct sufaFileHeader *header = needHugeZeroedMem(size);
+header->magic = SUFA_MAGIC;
+header->majorVersion = SUFA_MAJOR_VERSION;
+header->minorVersion = SUFA_MINOR_VERSION;
+header->size = size;
+header->chromCount = chromCount;
+header->chromNamesSize = namesSize;
+header->arraySize = arraySize;
+header->dnaDiskSize = dnaSize;
+
+struct sufa *sufa;
+AllocVar(sufa);
+sufa->header = header;
+sufa->isMapped = FALSE;
+AllocArray(sufa->chromNames, chromCount);
+AllocArray(sufa->chromOffsets, chromCount);
+char *s = pointerOffset(header, sizeof(*header));
+bits64 mapOffset = sizeof(*header) + namesSize;
+sufa->chromSizes = pointerOffset(header, mapOffset);
+mapOffset += sizeof(bits32) * chromCount;
+sufa->allDna = pointerOffset(header, mapOffset);
+mapOffset += dnaSize;
+sufa->array = pointerOffset(header, mapOffset);
+
+/* Copy in names and DNA. */
+bits32 offset = 0;
+for (seq = seqList, i=0; seq != NULL; seq = seq->next, ++i)
+    {
+    int j;
+    char *dna = sufa->allDna + offset;
+    strcpy(s, seq->name);
+    sufa->chromNames[i] = s;
+    s += strlen(s) + 1;
+    sufa->chromSizes[i] = seq->size;
+    sufa->chromOffsets[i] = offset;
+    for (j=0; j<seq->size; ++j)
+	dna[j] = (sufaIndexedBase(seq->dna[j]) ? seq->dna[j] : 'n');
+    offset += seq->size + 1;
+    }
+
+/* Sort all suffixes and keep the ones starting with real bases. */
+bits32 *all = needHugeMem(dnaSize * sizeof(all[0]));
+bits64 allIx, arrayIx = 0;
+sortSuffixes(sufa->allDna, dnaSize, all);
+for (allIx=0; allIx<dnaSize; ++allIx)
+    if (sufaIndexedBase(sufa->allDna[all[allIx]]))
+	sufa->array[arrayIx++] = all[allIx];
+assert(arrayIx == arraySize);
+freeMem(all);
+return sufa;
+}